@@ -0,0 +1,447 @@
+/*
+ * The state of aircraft, from what their extended squitters tell
+ */
+
+#include <string.h>
+
+#include "air.h"
+#include "airtab.h"
+#include "crc.h"
+
+#define AIR_MASK  (AIR_SIZE - 1)
+
+// The ME field of a DF17 as a 56-bit integer, and its bits a..b, from 1.
+#define ME_BITS(me, a, b) \
+	((unsigned int) ((me) >> (56 - (b))) & ((1u << ((b) - (a) + 1)) - 1))
+
+/*
+ * The 13-bit altitude code of the replies. We only do the 25 ft steps
+ * with the Q bit, which is what everyone flies with now, and return
+ * AIR_NONE for the rest. The DF17 carries the same code with the M bit
+ * taken out, ac12 is that.
+ */
+int ac13_alt(unsigned int ac13)
+{
+	unsigned int n;
+
+	if (ac13 == 0 || (ac13 & 0x40) != 0 || (ac13 & 0x10) == 0)
+		return AIR_NONE;
+	n = ((ac13 & 0x1F80) >> 2) | ((ac13 & 0x20) >> 1) | (ac13 & 0x0F);
+	return n * 25 - 1000;
+}
+
+int ac12_alt(unsigned int ac12)
+{
+	return ac13_alt(((ac12 & 0xFC0) << 1) | (ac12 & 0x3F));
+}
+
+/*
+ * The identity is in the same interleaved order as the altitude:
+ * C1 A1 C2 A2 C4 A4 X B1 D1 B2 D2 B4 D4, from the top of 13 bits.
+ */
+unsigned int id13_squawk(unsigned int id13)
+{
+	unsigned int a, b, c, d;
+
+	a = ((id13 >> 11) & 1) | ((id13 >> 9) & 1) << 1 |
+	    ((id13 >> 7) & 1) << 2;
+	b = ((id13 >> 5) & 1) | ((id13 >> 3) & 1) << 1 |
+	    ((id13 >> 1) & 1) << 2;
+	c = ((id13 >> 12) & 1) | ((id13 >> 10) & 1) << 1 |
+	    ((id13 >> 8) & 1) << 2;
+	d = ((id13 >> 4) & 1) | ((id13 >> 2) & 1) << 1 |
+	    ((id13 >> 0) & 1) << 2;
+	return a*1000 + b*100 + c*10 + d;
+}
+
+static const char ais_chars[] =
+    "?ABCDEFGHIJKLMNOPQRSTUVWXYZ????? ???????????????0123456789??????";
+
+/*
+ * The identification: 8 characters of 6 bits after the first byte of
+ * the ME. The trailing spaces are dropped.
+ */
+void ais_call(const unsigned char *me, char *call)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		call[i] = ais_chars[(me[1 + (i*6)/8] << 8 |
+		    me[2 + (i*6)/8]) >> (10 - (i*6)%8) & 0x3F];
+	}
+	call[8] = 0;
+	for (i = 7; i >= 0 && call[i] == ' '; i--)
+		call[i] = 0;
+}
+
+/*
+ * The CPR, in binary angles. A zone of the latitude is 2^32/(60-odd),
+ * and the encoded position within it is 17 bits, so a position is the
+ * zone and the 17 bits, times 2^15, over the number of zones.
+ */
+int cpr_nl(int32_t lat)
+{
+	uint32_t a;
+	int nl;
+
+	a = (lat < 0) ? -(uint32_t) lat : (uint32_t) lat;
+	if (a > 1u << 30)
+		return 1;
+	nl = nl_tab[a >> NL_SHIFT];
+	if (a >= nl_edge[nl])
+		nl--;
+	return nl;
+}
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static int mod_pos(int64_t a, int b)
+{
+	int r = a % b;
+	return (r < 0) ? r + b : r;
+}
+
+static int32_t cpr_angle(int64_t zone, uint32_t z, int nz)
+{
+	return (int32_t) (uint32_t) (((zone << 17) + z) * (1 << 15) / nz);
+}
+
+/*
+ * The global decode from a pair: yz[] and xz[] are even and odd, and
+ * odd says which of them came last. Return 0 if the pair straddles
+ * a change of NL() and so cannot be decoded.
+ */
+int cpr_global(const uint32_t *yz, const uint32_t *xz, int odd,
+    int32_t *latp, int32_t *lonp)
+{
+	int32_t lat0, lat1, lat;
+	int64_t j, m;
+	int nl, ni;
+
+	j = floor_div(59 * (int64_t) yz[0] - 60 * (int64_t) yz[1] +
+	    (1 << 16), 1 << 17);
+	lat0 = cpr_angle(mod_pos(j, 60), yz[0], 60);
+	lat1 = cpr_angle(mod_pos(j, 59), yz[1], 59);
+	if (lat0 > 1 << 30 || lat0 < -(1 << 30) ||
+	    lat1 > 1 << 30 || lat1 < -(1 << 30))
+		return -1;
+	nl = cpr_nl(lat0);
+	if (nl != cpr_nl(lat1))
+		return -1;
+	lat = odd ? lat1 : lat0;
+
+	ni = (nl - odd > 1) ? nl - odd : 1;
+	m = floor_div((int64_t) xz[0] * (nl - 1) - (int64_t) xz[1] * nl +
+	    (1 << 16), 1 << 17);
+	*latp = lat;
+	*lonp = cpr_angle(mod_pos(m, ni), xz[odd], ni);
+	return 0;
+}
+
+/*
+ * The zone of the reference is the zone of the result, unless the
+ * encoded position is more than half a zone away from the reference.
+ */
+static int32_t cpr_near(int32_t ref, uint32_t z, int nz)
+{
+	int64_t r, zone, d;
+
+	r = (int64_t) ref * nz;
+	zone = r >> 32;
+	d = (r - (zone << 32)) - ((int64_t) z << 15) + (1LL << 31);
+	zone += d >> 32;
+	return cpr_angle(zone, z, nz);
+}
+
+int cpr_local(uint32_t yz, uint32_t xz, int odd, int32_t ref_lat,
+    int32_t ref_lon, int32_t *latp, int32_t *lonp)
+{
+	int32_t lat;
+	int ni;
+
+	lat = cpr_near(ref_lat, yz, 60 - odd);
+	if (lat > 1 << 30 || lat < -(1 << 30))
+		return -1;
+	ni = cpr_nl(lat) - odd;
+	if (ni < 1)
+		ni = 1;
+	*latp = lat;
+	*lonp = cpr_near(ref_lon, xz, ni);
+	return 0;
+}
+
+static unsigned int isqrt(unsigned int v)
+{
+	unsigned int r = 0, bit = 1u << 30;
+
+	while (bit > v)
+		bit >>= 2;
+	while (bit != 0) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return r;
+}
+
+/*
+ * The arc-tangent of y/x for 0 <= y <= x, x > 0, in 0.01 degree.
+ */
+static int atan_01(unsigned int y, unsigned int x)
+{
+	unsigned int r, i, f;
+
+	r = (y * ATAN_N * 256) / x;
+	i = r >> 8;
+	f = r & 0xFF;
+	if (i >= ATAN_N)
+		return atan_tab[ATAN_N];
+	return atan_tab[i] + (((atan_tab[i+1] - atan_tab[i]) * f) >> 8);
+}
+
+/*
+ * The track from north, clockwise, 0 to 35999.
+ */
+static int track_of(int ew, int ns)
+{
+	unsigned int ax = (ns < 0) ? -ns : ns, ay = (ew < 0) ? -ew : ew;
+	int a;
+
+	if (ax == 0 && ay == 0)
+		return AIR_NONE;
+	a = (ay <= ax) ? atan_01(ay, ax) : 9000 - atan_01(ax, ay);
+	if (ns >= 0)
+		return (ew >= 0) ? a : (36000 - a) % 36000;
+	return (ew >= 0) ? 18000 - a : 18000 + a;
+}
+
+static unsigned int air_hash(uint32_t addr)
+{
+	return (addr * 0x9E3779B1u) >> (32 - 12);	// 12 bits for AIR_SIZE
+}
+
+void air_init(struct air *tab)
+{
+	memset(tab, 0, sizeof(struct air));
+	crc_init();
+}
+
+struct aircraft *air_find(struct air *tab, uint32_t addr)
+{
+	unsigned int x;
+
+	for (x = air_hash(addr); tab->vec[x].used; x = (x + 1) & AIR_MASK) {
+		if (tab->vec[x].addr == addr)
+			return &tab->vec[x];
+	}
+	return NULL;
+}
+
+/*
+ * Find the aircraft, or make it. Return NULL if the table is full,
+ * where we stop short of the last slot, for air_find() to terminate.
+ */
+static struct aircraft *air_get(struct air *tab, uint32_t addr)
+{
+	struct aircraft *ap;
+	unsigned int x;
+
+	for (x = air_hash(addr); tab->vec[x].used; x = (x + 1) & AIR_MASK) {
+		if (tab->vec[x].addr == addr)
+			return &tab->vec[x];
+	}
+	if (tab->count == AIR_SIZE - 1)
+		return NULL;
+	tab->count++;
+	ap = &tab->vec[x];
+	memset(ap, 0, sizeof(struct aircraft));
+	ap->used = 1;
+	ap->addr = addr;
+	ap->alt = AIR_NONE;
+	ap->gs = AIR_NONE;
+	ap->track = AIR_NONE;
+	ap->vr = AIR_NONE;
+	return ap;
+}
+
+static void air_position(struct air *tab, struct aircraft *ap,
+    uint64_t me, uint64_t ms)
+{
+	int odd = ME_BITS(me, 22, 22);
+	int32_t lat, lon;
+
+	ap->cpr_lat[odd] = ME_BITS(me, 23, 39);
+	ap->cpr_lon[odd] = ME_BITS(me, 40, 56);
+	ap->cpr_seen[odd] = ms;
+
+	if (ap->cpr_seen[!odd] != 0 &&
+	    air_age(ms, ap->cpr_seen[!odd]) < CPR_PAIR) {
+		if (cpr_global(ap->cpr_lat, ap->cpr_lon, odd,
+		    &lat, &lon) != 0) {
+			tab->st.bad++;
+			return;
+		}
+		tab->st.global++;
+	} else if (ap->pos_seen != 0 &&
+	    air_age(ms, ap->pos_seen) < CPR_LOCAL) {
+		if (cpr_local(ap->cpr_lat[odd], ap->cpr_lon[odd], odd,
+		    ap->lat, ap->lon, &lat, &lon) != 0) {
+			tab->st.bad++;
+			return;
+		}
+		tab->st.local++;
+	} else {
+		return;
+	}
+	ap->lat = lat;
+	ap->lon = lon;
+	ap->pos_seen = ms;
+}
+
+static void air_velocity(struct aircraft *ap, uint64_t me)
+{
+	unsigned int st = ME_BITS(me, 6, 8);
+	int ew, ns, v;
+
+	if (st == 1 || st == 2) {
+		ew = ME_BITS(me, 15, 24);
+		ns = ME_BITS(me, 26, 35);
+		if (ew != 0 && ns != 0) {
+			ew = (ew - 1) * (st == 2 ? 4 : 1);
+			ns = (ns - 1) * (st == 2 ? 4 : 1);
+			if (ME_BITS(me, 14, 14))
+				ew = -ew;
+			if (ME_BITS(me, 25, 25))
+				ns = -ns;
+			ap->gs = isqrt(ew*ew + ns*ns);
+			ap->track = track_of(ew, ns);
+		}
+	}
+	if (st >= 1 && st <= 4) {
+		v = ME_BITS(me, 38, 46);
+		if (v != 0) {
+			v = (v - 1) * 64;
+			ap->vr = ME_BITS(me, 37, 37) ? -v : v;
+		}
+	}
+}
+
+/*
+ * Return 1 if the frame is an extended squitter with the ME of the ADS-B.
+ * The DF18 with the CF of 0, 1 or 6 carries the same ME as the DF17,
+ * from a non-transponder device, an anonymous address, or a rebroadcast.
+ * The rest of the DF18, such as the TIS-B, only count as being heard.
+ */
+int air_es(const unsigned char *pkt, unsigned int plen)
+{
+	unsigned int df = pkt[0] >> 3, cf = pkt[0] & 7;
+
+	if (plen != 14)
+		return 0;
+	return df == 17 || (df == 18 && (cf == 0 || cf == 1 || cf == 6));
+}
+
+/*
+ * Take what a good frame tells about its aircraft, and return the
+ * aircraft, or NULL if the frame has no address.
+ *
+ * The type codes 20 to 22 are positions with the GNSS height, which does
+ * not go into the barometric altitude.
+ */
+struct aircraft *air_update(struct air *tab, const unsigned char *pkt,
+    unsigned int plen, uint64_t ms, unsigned int rssi)
+{
+	struct aircraft *ap;
+	uint32_t addr;
+	uint64_t me;
+	unsigned int df, tc;
+	int i;
+
+	df = pkt[0] >> 3;
+	switch (df) {
+	case 11:
+	case 17:
+	case 18:
+		addr = pkt[1] << 16 | pkt[2] << 8 | pkt[3];
+		break;
+	case 0:
+	case 4:
+	case 5:
+	case 16:
+	case 20:
+	case 21:
+		addr = crc_syndrome(pkt, plen);
+		break;
+	default:
+		return NULL;
+	}
+	if ((ap = air_get(tab, addr)) == NULL)
+		return NULL;
+	ap->seen = ms;
+	ap->messages++;
+	ap->rssi = rssi;
+	if (!air_es(pkt, plen))
+		return ap;
+	memcpy(ap->last, pkt, 14);
+	ap->last_seen = ms;
+
+	me = 0;
+	for (i = 4; i < 11; i++)
+		me = me << 8 | pkt[i];
+	tc = pkt[4] >> 3;
+	if (tc >= 1 && tc <= 4) {
+		ais_call(pkt + 4, ap->call);
+	} else if (tc >= 9 && tc <= 18) {
+		i = ac12_alt(ME_BITS(me, 9, 20));
+		if (i != AIR_NONE)
+			ap->alt = i;
+		air_position(tab, ap, me, ms);
+	} else if (tc >= 20 && tc <= 22) {
+		air_position(tab, ap, me, ms);
+	} else if (tc == 19) {
+		air_velocity(ap, me);
+	}
+	return ap;
+}
+
+static void air_delete(struct air *tab, unsigned int i)
+{
+	unsigned int j, k;
+
+	tab->count--;
+	for (;;) {
+		tab->vec[i].used = 0;
+		j = i;
+		for (;;) {
+			j = (j + 1) & AIR_MASK;
+			if (!tab->vec[j].used)
+				return;
+			// The entry at j stays if its home is in (i, j].
+			k = air_hash(tab->vec[j].addr);
+			if (((j - k) & AIR_MASK) >= ((j - i) & AIR_MASK))
+				break;
+		}
+		tab->vec[i] = tab->vec[j];
+		i = j;
+	}
+}
+
+void air_expire(struct air *tab, uint64_t ms)
+{
+	unsigned int i;
+
+	for (i = 0; i < AIR_SIZE; ) {
+		if (tab->vec[i].used &&
+		    air_age(ms, tab->vec[i].seen) >= AIR_TTL)
+			air_delete(tab, i);	// may move another into i
+		else
+			i++;
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * The state of aircraft, from what their extended squitters tell
+ *
+ * Every frame with an address counts as the aircraft being heard. The
+ * frames that overlay the parity with the address must have been checked
+ * against the address cache before they get here.
+ *
+ * Only the consumer thread updates the table, so there are no locks.
+ * The table is open-addressed by the ICAO address, and aircraft that went
+ * silent are taken out, with the rest of the run shifted back.
+ *
+ * Positions are binary angles: the full circle is 2^32, so an int32_t
+ * latitude or longitude wraps around just like the Earth does.
+ */
+
+#include <stdint.h>
+
+#define AIR_SIZE   4096		// a power of 2, more than a receiver hears
+#define AIR_TTL    60000	// ms of silence until an aircraft goes
+#define CPR_PAIR   10000	// ms between the even and odd for a global fix
+#define CPR_LOCAL  30000	// ms that a position may serve as a reference
+
+#define AIR_NONE   INT32_MIN	// unknown altitude, speed, etc.
+
+struct aircraft {
+	uint32_t addr;
+	int used;
+	uint64_t seen;		// ms
+	unsigned long messages;
+	unsigned int rssi;	// of the last frame, 0..255 like the Beast
+	unsigned char last[14];	// the last squitter, if last_seen
+	uint64_t last_seen;	// ms, 0 if no DF17 or DF18
+	char call[9];		// empty if unknown
+	int alt;		// barometric, ft
+	int gs;			// ground speed, kt
+	int track;		// in 0.01 degree, from the ground speed
+	int vr;			// vertical rate, ft/min
+	int32_t lat, lon;
+	uint64_t pos_seen;	// ms, 0 if no position
+	uint32_t cpr_lat[2], cpr_lon[2];	// even and odd, 17 bits
+	uint64_t cpr_seen[2];	// ms, 0 if none
+};
+
+struct air_stats {
+	unsigned long global, local;	// the CPR fixes
+	unsigned long bad;		// the CPR pairs that did not agree
+};
+
+struct air {
+	unsigned int count;
+	struct air_stats st;
+	struct aircraft vec[AIR_SIZE];
+};
+
+int ac13_alt(unsigned int ac13);
+int ac12_alt(unsigned int ac12);
+unsigned int id13_squawk(unsigned int id13);
+void ais_call(const unsigned char *me, char *call);
+
+int air_es(const unsigned char *pkt, unsigned int plen);
+
+void air_init(struct air *tab);
+struct aircraft *air_find(struct air *tab, uint32_t addr);
+struct aircraft *air_update(struct air *tab, const unsigned char *pkt,
+    unsigned int plen, uint64_t ms, unsigned int rssi);
+void air_expire(struct air *tab, uint64_t ms);
+
+/*
+ * How long ago t was at ms. The frames of several sources or workers are
+ * not quite in order, so an aircraft may be newer than the clock we ask
+ * with, and then it was heard just now.
+ */
+static inline uint64_t air_age(uint64_t ms, uint64_t t)
+{
+	return (ms > t) ? ms - t : 0;
+}
+
+int cpr_nl(int32_t lat);
+int cpr_global(const uint32_t *yz, const uint32_t *xz, int odd,
+    int32_t *latp, int32_t *lonp);
+int cpr_local(uint32_t yz, uint32_t xz, int odd, int32_t ref_lat,
+    int32_t ref_lon, int32_t *latp, int32_t *lonp);
@@ -0,0 +1,126 @@
+#!/usr/bin/python3
+#
+# The generator of lookup tables for the aircraft state: the number of
+# longitude zones NL() of the CPR, and the arc-tangent for the track
+#
+# The angles are binary: the whole circle is 2^32, so the latitude of
+# 90 degrees is 2^30.
+#
+
+import math
+import sys
+
+TAG="airgen"
+
+# The number of latitude zones between the equator and a pole.
+NZ = 15
+
+# The NL() is looked up by the top bits of |lat|, from 0 to 90 degrees.
+NL_SHIFT = 20
+
+# The arc-tangent of y/x for 0 <= y <= x, at 1/ATAN_N steps of the ratio.
+ATAN_N = 256
+
+class ParamError(Exception):
+    pass
+
+class Param:
+    def __init__(self, argv):
+        skip = 1;  # Do skip=1 for full argv.
+        #: Output name, stdout if not given
+        self.outname = None
+        for i in range(len(argv)):
+            if skip:
+                skip = 0
+                continue
+            arg = argv[i]
+            if len(arg) != 0 and arg[0] == '-':
+                if arg == "-o":
+                    if i+1 == len(argv):
+                        raise ParamError("Parameter -o needs an argument")
+                    self.outname = argv[i+1]
+                    skip = 1;
+                else:
+                    raise ParamError("Unknown parameter " + arg)
+            else:
+                raise ParamError("Positional parameter supplied")
+
+
+# The latitude in degrees above which the NL() drops below nl.
+def nl_edge(nl):
+    a = 1.0 - math.cos(math.pi / (2.0 * NZ))
+    b = 1.0 - math.cos(2.0 * math.pi / nl)
+    return math.degrees(math.acos(math.sqrt(a / b)))
+
+def nl_deg(lat):
+    lat = abs(lat)
+    for nl in range(59, 1, -1):
+        if lat < nl_edge(nl):
+            return nl
+    return 1
+
+def bin_angle(deg):
+    return int(math.floor(deg * (1 << 32) / 360.0))
+
+def main(args):
+    try:
+        par = Param(args)
+    except ParamError as e:
+        print(TAG+": %s" % e, file=sys.stderr)
+        print("Usage:", TAG+" [-o outfile]", file=sys.stderr)
+        return 1
+
+    if par.outname:
+        outfp = open(par.outname, 'w')
+    else:
+        outfp = sys.stdout
+
+    #
+    # The edges, for nl from 2 to 59, in binary angles. The NL() is 59
+    # below the edge of 59. The entries for 0 and 1 are never looked at.
+    #
+    print("#define NL_SHIFT  %d" % (NL_SHIFT,), file=outfp)
+    print("", file=outfp)
+    print("static const uint32_t nl_edge[60] = {", file=outfp)
+    print("  0xffffffff, 0xffffffff,", file=outfp)
+    for nl in range(2, 60):
+        edge = nl_edge(nl)
+        print("  0x%08x%s // %2d, %.8f" %
+              (bin_angle(edge), ("" if nl == 59 else ","), nl, edge),
+              file=outfp)
+    print("};", file=outfp)
+
+    #
+    # The NL() at the bottom of every bucket. Buckets are narrower than
+    # the gaps between the edges, so at most one edge is in a bucket.
+    #
+    nb = (1 << 30 >> NL_SHIFT) + 1
+    print("", file=outfp)
+    print("static const unsigned char nl_tab[%d] = {" % (nb,), file=outfp)
+    for i in range(nb):
+        deg = (i << NL_SHIFT) * 360.0 / (1 << 32)
+        sep = "" if i == nb - 1 else ","
+        print("  %2d%s // %.5f" % (nl_deg(deg), sep, deg), file=outfp)
+    print("};", file=outfp)
+
+    #
+    # The arc-tangent in hundredths of a degree.
+    #
+    print("", file=outfp)
+    print("#define ATAN_N  %d" % (ATAN_N,), file=outfp)
+    print("", file=outfp)
+    print("static const unsigned short atan_tab[%d] = {" % (ATAN_N+1,),
+          file=outfp)
+    for i in range(ATAN_N + 1):
+        v = int(round(math.degrees(math.atan(i / ATAN_N)) * 100.0))
+        sep = "" if i == ATAN_N else ","
+        print("  %4d%s // %d/%d" % (v, sep, i, ATAN_N), file=outfp)
+    print("};", file=outfp)
+
+    if par.outname:
+        outfp.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -12,11 +12,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 
 #include <airspy.h>
 
 // #include "fec.h"
+#include "rec.h"
+#include "ring.h"
 #include "upd.h"
 #include "xyphi.h"
 
@@ -29,6 +32,7 @@ struct param {
 	int mix_gain;
 	int vga_gain;
 	float freq;	/* in MHz */
+	char *rec_name;
 };
 
 #define HGLEN 20
@@ -50,10 +54,11 @@ struct rx_counts {
 	unsigned long c_nocore;
 	unsigned long c_bufdrop;
 	unsigned long c_bufcnt;
+	unsigned int c_poolhw;	// the most packets out of the pool
 };
 
 struct packet {
-	struct packet *next;
+	_Alignas(RING_CLSZ) struct packet *next;
 	int num;		// number of complex samples
 	short int *buf;
 };
@@ -65,12 +70,16 @@ static void scan_buf_am1(struct rx_state *rsp, struct packet *pp);
 static void dump_buf(struct rx_state *rsp, struct packet *pp);
 static void timer_print(
     unsigned long bufcnt, unsigned long bufdrop, unsigned long nocore,
-    struct rx_state *rsp);
+    unsigned int poolhw, struct rx_state *rsp, struct rec_stats *wsp);
 static void parse(struct param *p, char **argv);
 static void Usage(void);
 static int rx_callback(airspy_transfer_t *xfer);
 static int rx_callback_am1(airspy_transfer_t *xfer);
 static unsigned int dc_bias_update(unsigned char *sp);
+static int pool_init(void);
+static void pool_fini(void);
+static struct packet *pool_get(void);
+static void pool_put(struct packet *pp);
 
 static struct param par;
 
@@ -87,12 +96,35 @@ static unsigned int bias_timer;
 
 #define PMAX  20
 
+/*
+ * The packets come from a fixed pool, so the callback never calls malloc.
+ * There's one packet more than PMAX, for the one being scanned, but
+ * between the packets the main thread holds none, and all NPOOL of them
+ * may be queued.
+ * The main thread returns packets through a ring, and the callback takes
+ * them from it. The buffers fit the largest transfer of libairspy, with
+ * 2 shorts per sample for FM, and are backed by huge pages if we can.
+ */
+#define NPOOL     (PMAX + 1)
+#define NPRING    32		// a power of 2 that is at least NPOOL
+#define XFER_MAX  (128*1024)	// samples in a transfer
+#define PBUFSZ    (XFER_MAX * 2 * sizeof(short))
+#define HUGESZ    (2*1024*1024)
+
+static struct packet pool_vec[NPOOL];
+static struct packet *pool_free[NPRING];
+static struct ring pool_ring;
+static void *pool_base;
+static size_t pool_len;
+
 static pthread_mutex_t rx_mutex;
 static pthread_cond_t rx_cond;
 unsigned int pcnt;
 struct packet *phead, *ptail;
 struct rx_counts c_stat;
 
+static struct rec rec;
+
 int main(int argc, char **argv)
 {
 	struct airspy_device *device = NULL;
@@ -111,6 +143,14 @@ int main(int argc, char **argv)
 		goto err_upd;
 	}
 
+	if (pool_init() != 0)
+		goto err_pool;
+
+	if (par.rec_name != NULL) {
+		if (rec_open(&rec, par.rec_name) != 0)
+			goto err_rec;
+	}
+
 	rc = airspy_init();
 	if (rc != AIRSPY_SUCCESS) {
 		fprintf(stderr, TAG ": airspy_init() failed: %s (%d)\n",
@@ -265,8 +305,7 @@ int main(int argc, char **argv)
 				scan_buf_fm(&rxstate, pp);
 			}
 
-			free(pp->buf);
-			free(pp);
+			pool_put(pp);
 
 			pthread_mutex_lock(&rx_mutex);
 			c_stat.c_bufcnt++;
@@ -274,15 +313,21 @@ int main(int argc, char **argv)
 			gettimeofday(&now, NULL);
 			if (now.tv_sec >= count_last.tv_sec + 10) {
 				unsigned long bufcnt, bufdrop, nocore;
+				unsigned int poolhw;
+				struct rec_stats wst;
 
 				nocore = c_stat.c_nocore;
 				bufdrop = c_stat.c_bufdrop;
 				bufcnt = c_stat.c_bufcnt;
+				poolhw = c_stat.c_poolhw;
 				memset(&c_stat, 0, sizeof(struct rx_counts));
 
 				pthread_mutex_unlock(&rx_mutex);
 
-				timer_print(bufcnt, bufdrop, nocore, &rxstate);
+				if (par.rec_name != NULL)
+					rec_stats(&rec, &wst);
+				timer_print(bufcnt, bufdrop, nocore, poolhw,
+				    &rxstate, (par.rec_name != NULL) ? &wst : NULL);
 
 				count_last = now;
 				pthread_mutex_lock(&rx_mutex);
@@ -300,9 +345,12 @@ int main(int argc, char **argv)
 	}
 
 	airspy_stop_rx(device);
+	if (par.rec_name != NULL)
+		rec_close(&rec);
 	airspy_close(device);
 	airspy_exit();
 
+	pool_fini();
 	rx_state_fini(&rxstate);
 	return 0;
 
@@ -317,6 +365,11 @@ err_sample:
 err_open:
 	airspy_exit();
 err_init:
+	if (par.rec_name != NULL)
+		rec_close(&rec);
+err_rec:
+	pool_fini();
+err_pool:
 	rx_state_fini(&rxstate);
 err_upd:
 	return 1;
@@ -523,7 +576,9 @@ static void timer_print(
     unsigned long bufcnt,
     unsigned long bufdrop,
     unsigned long nocore,
-    struct rx_state *rsp)
+    unsigned int poolhw,
+    struct rx_state *rsp,
+    struct rec_stats *wsp)
 {
 	int i;
 	int avg_i, avg_q;
@@ -535,19 +590,26 @@ static void timer_print(
 	if (par.mode_recv == 0) {
 		fprintf(stderr, "# bufs %lu nocore %lu drop %lu"
 		    " badx %lu bady %lu avg I %d Q %d"
-		    " fme1 %lu fme2 %lu (d %f x %d)\n",
+		    " fme1 %lu fme2 %lu (d %f x %d)",
 		    bufcnt, nocore, bufdrop, rsp->badx, rsp->bady,
 		    avg_i, avg_q, rsp->fm_e1, rsp->fm_e2,
 		    rsp->fm_e2_save_d, rsp->fm_e2_save_x);
 	} else {
 		fprintf(stderr, "# bufs %lu nocore %lu drop %lu"
 		    " badx %lu avg amp %d center %d"
-		    " fme1 %lu fme2 %lu (d %f x %d)\n",
+		    " fme1 %lu fme2 %lu (d %f x %d)",
 		    bufcnt, nocore, bufdrop, rsp->badx,
 		    UPD_CUR(&rsp->uavg_am), UPD_CUR(&rsp->uavg_am_base),
 		    rsp->fm_e1, rsp->fm_e2,
 		    rsp->fm_e2_save_d, rsp->fm_e2_save_x);
 	}
+	fprintf(stderr, " pool %u/%u max %u",
+	    NPOOL - ring_count(&pool_ring), NPOOL, poolhw);
+	if (wsp != NULL) {
+		fprintf(stderr, " wr %llu stall %lu drop %lu",
+		    wsp->bytes, wsp->stalls, wsp->drops);
+	}
+	fprintf(stderr, "\n");
 
 	rsp->badx = 0;
 	rsp->bady = 0;
@@ -637,6 +699,12 @@ static void parse(struct param *p, char **argv)
 				p->vga_gain = lv;
 			} else if (strcmp(arg+1, "am1") == 0) {
 				p->mode_recv = 1;
+			} else if (strcmp(arg+1, "w") == 0) {
+				if ((arg = *argv++) == NULL) {
+					fprintf(stderr, TAG ": missing -w file\n");
+					Usage();
+				}
+				p->rec_name = arg;
 			} else {
 				Usage();
 			}
@@ -655,7 +723,8 @@ static void parse(struct param *p, char **argv)
 static void Usage(void)
 {
 	fprintf(stderr, "Usage: " TAG " [-c NNNN] [-am1]"
-            " [-ga lna_gain] [-gm mix_gain] [-gv vga_gain] 93.7\n");
+            " [-ga lna_gain] [-gm mix_gain] [-gv vga_gain]"
+            " [-w file.raw] 93.7\n");
 	exit(1);
 }
 
@@ -666,6 +735,9 @@ static int rx_callback(airspy_transfer_t *xfer)
 	struct packet *pp;
 	short int *buf, *bp;
 
+	if (par.rec_name != NULL)
+		rec_put(&rec, xfer->samples, xfer->sample_count * 2);
+
 	if (bias_timer == 0) {
 		if (xfer->sample_count >= BVLEN) {
 			sp = xfer->samples;
@@ -677,13 +749,20 @@ static int rx_callback(airspy_transfer_t *xfer)
 	/*
 	 * Premature optimization is the root of all evil. -- D. Knuth
 	 */
-	buf = malloc(xfer->sample_count * 2 * sizeof(short));
-	if (buf == NULL) {
+	if (xfer->sample_count > XFER_MAX) {
 		pthread_mutex_lock(&rx_mutex);
 		c_stat.c_nocore++;
 		pthread_mutex_unlock(&rx_mutex);
 		return 0;
 	}
+	pp = pool_get();
+	if (pp == NULL) {
+		pthread_mutex_lock(&rx_mutex);
+		c_stat.c_bufdrop++;
+		pthread_mutex_unlock(&rx_mutex);
+		return 0;
+	}
+	buf = pp->buf;
 
 	bp = buf;
 	sp = xfer->samples;
@@ -720,27 +799,12 @@ static int rx_callback(airspy_transfer_t *xfer)
 		sp += 8;
 	}
 
-	pp = malloc(sizeof(struct packet));
-	if (pp == NULL) {
-		free(bp);
-		pthread_mutex_lock(&rx_mutex);
-		c_stat.c_nocore++;
-		pthread_mutex_unlock(&rx_mutex);
-		return 0;
-	}
-	memset(pp, 0, sizeof(struct packet));
+	pp->next = NULL;
 	pp->num = xfer->sample_count;
-	pp->buf = buf;
 
+	// The queue only holds packets of the pool, no more than NPOOL of
+	// them, so there's no check.
 	pthread_mutex_lock(&rx_mutex);
-	if (pcnt >= PMAX) {
-		c_stat.c_bufdrop++;
-		pthread_mutex_unlock(&rx_mutex);
-		free(pp->buf);
-		free(pp);
-		return 0;
-	}
-
 	if (pcnt == 0) {
 		phead = pp;
 		ptail = pp;
@@ -749,6 +813,8 @@ static int rx_callback(airspy_transfer_t *xfer)
 		ptail = pp;
 	}
 	pcnt++;
+	if (NPOOL - ring_count(&pool_ring) > c_stat.c_poolhw)
+		c_stat.c_poolhw = NPOOL - ring_count(&pool_ring);
 	pthread_cond_broadcast(&rx_cond);
 	pthread_mutex_unlock(&rx_mutex);
 
@@ -762,6 +828,9 @@ static int rx_callback_am1(airspy_transfer_t *xfer)
 	struct packet *pp;
 	short int *buf, *bp;
 
+	if (par.rec_name != NULL)
+		rec_put(&rec, xfer->samples, xfer->sample_count * 2);
+
 	if (bias_timer == 0) {
 		if (xfer->sample_count >= BVLEN) {
 			sp = xfer->samples;
@@ -770,13 +839,20 @@ static int rx_callback_am1(airspy_transfer_t *xfer)
 	}
 	bias_timer = (bias_timer + 1) % 10;
 
-	buf = malloc(xfer->sample_count * sizeof(short));
-	if (buf == NULL) {
+	if (xfer->sample_count > XFER_MAX) {
 		pthread_mutex_lock(&rx_mutex);
 		c_stat.c_nocore++;
 		pthread_mutex_unlock(&rx_mutex);
 		return 0;
 	}
+	pp = pool_get();
+	if (pp == NULL) {
+		pthread_mutex_lock(&rx_mutex);
+		c_stat.c_bufdrop++;
+		pthread_mutex_unlock(&rx_mutex);
+		return 0;
+	}
+	buf = pp->buf;
 
 	bp = buf;
 	sp = xfer->samples;
@@ -792,27 +868,12 @@ static int rx_callback_am1(airspy_transfer_t *xfer)
 		sp += 2;
 	}
 
-	pp = malloc(sizeof(struct packet));
-	if (pp == NULL) {
-		free(bp);
-		pthread_mutex_lock(&rx_mutex);
-		c_stat.c_nocore++;
-		pthread_mutex_unlock(&rx_mutex);
-		return 0;
-	}
-	memset(pp, 0, sizeof(struct packet));
+	pp->next = NULL;
 	pp->num = xfer->sample_count;
-	pp->buf = buf;
 
+	// The queue only holds packets of the pool, no more than NPOOL of
+	// them, so there's no check.
 	pthread_mutex_lock(&rx_mutex);
-	if (pcnt >= PMAX) {
-		c_stat.c_bufdrop++;
-		pthread_mutex_unlock(&rx_mutex);
-		free(pp->buf);
-		free(pp);
-		return 0;
-	}
-
 	if (pcnt == 0) {
 		phead = pp;
 		ptail = pp;
@@ -821,6 +882,8 @@ static int rx_callback_am1(airspy_transfer_t *xfer)
 		ptail = pp;
 	}
 	pcnt++;
+	if (NPOOL - ring_count(&pool_ring) > c_stat.c_poolhw)
+		c_stat.c_poolhw = NPOOL - ring_count(&pool_ring);
 	pthread_cond_broadcast(&rx_cond);
 	pthread_mutex_unlock(&rx_mutex);
 
@@ -840,3 +903,67 @@ static unsigned int dc_bias_update(unsigned char *sp)
 	}
 	return sum / BVLEN;
 }
+
+/*
+ * A single mapping for all the buffers. If the kernel has no huge pages
+ * reserved, ask for the transparent ones, and take small pages if not.
+ * Touch it all now, so the callback does not take page faults.
+ */
+static int pool_init(void)
+{
+	unsigned char *p;
+	unsigned int i;
+
+	pool_len = (NPOOL * PBUFSZ + HUGESZ - 1) & ~(size_t) (HUGESZ - 1);
+	pool_base = mmap(NULL, pool_len, PROT_READ|PROT_WRITE,
+	    MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if (pool_base == MAP_FAILED) {
+		pool_base = mmap(NULL, pool_len, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (pool_base == MAP_FAILED) {
+			fprintf(stderr, TAG ": No core for %u buffers\n",
+			    NPOOL);
+			return -1;
+		}
+		madvise(pool_base, pool_len, MADV_HUGEPAGE);
+	}
+	memset(pool_base, 0, pool_len);
+
+	ring_init(&pool_ring, NPRING);
+	p = pool_base;
+	for (i = 0; i < NPOOL; i++) {
+		pool_vec[i].buf = (short int *) (p + i * PBUFSZ);
+		pool_put(&pool_vec[i]);
+	}
+	return 0;
+}
+
+static void pool_fini(void)
+{
+	munmap(pool_base, pool_len);
+}
+
+// The callback only. Returns NULL if all packets are out.
+static struct packet *pool_get(void)
+{
+	struct packet *pp;
+	int x;
+
+	x = ring_get_begin(&pool_ring);
+	if (x < 0)
+		return NULL;
+	pp = pool_free[x];
+	ring_get_end(&pool_ring);
+	return pp;
+}
+
+// The main thread only, after the callback is done with the packet.
+static void pool_put(struct packet *pp)
+{
+	int x;
+
+	// Never full, because the ring is bigger than the pool.
+	x = ring_put_begin(&pool_ring);
+	pool_free[x] = pp;
+	ring_put_end(&pool_ring);
+}
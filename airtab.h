@@ -0,0 +1,1353 @@
+#define NL_SHIFT  20
+
+static const uint32_t nl_edge[60] = {
+  0xffffffff, 0xffffffff,
+  0x3ddddddd, //  2, 87.00000000
+  0x3d894889, //  3, 86.53536998
+  0x3cfb4c0e, //  4, 85.75541621
+  0x3c5e0e30, //  5, 84.89166191
+  0x3bba3a95, //  6, 83.99173563
+  0x3b12cb8a, //  7, 83.07199445
+  0x3a690d66, //  8, 82.13956981
+  0x39bda5b2, //  9, 81.19801349
+  0x3910ed48, // 10, 80.24923213
+  0x38631564, // 11, 79.29428225
+  0x37b438ea, // 12, 78.33374083
+  0x37046538, // 13, 77.36789461
+  0x36539efa, // 14, 76.39684391
+  0x35a1e4f8, // 15, 75.42056257
+  0x34ef31c5, // 16, 74.43893416
+  0x343b7cca, // 17, 73.45177442
+  0x3386baf2, // 18, 72.45884545
+  0x32d0df12, // 19, 71.45986473
+  0x3219da2e, // 20, 70.45451075
+  0x31619ba0, // 21, 69.44242631
+  0x30a8112e, // 22, 68.42322022
+  0x2fed270c, // 23, 67.39646774
+  0x2f30c7d8, // 24, 66.36171008
+  0x2e72dc8b, // 25, 65.31845310
+  0x2db34c60, // 26, 64.26616523
+  0x2cf1fcb2, // 27, 63.20427479
+  0x2c2ed0d4, // 28, 62.13216659
+  0x2b69a9e4, // 29, 61.04917774
+  0x2aa26689, // 30, 59.95459277
+  0x29d8e2b1, // 31, 58.84763776
+  0x290cf741, // 32, 57.72747354
+  0x283e79b3, // 33, 56.59318756
+  0x276d3ba1, // 34, 55.44378444
+  0x26990a48, // 35, 54.27817472
+  0x25c1adde, // 36, 53.09516153
+  0x24e6e8e0, // 37, 51.89342469
+  0x24087722, // 38, 50.67150166
+  0x23260cc6, // 39, 49.42776439
+  0x223f54e8, // 40, 48.16039128
+  0x2153f000, // 41, 46.86733252
+  0x206371e5, // 42, 45.54626723
+  0x1f6d5f49, // 43, 44.19454951
+  0x1e712a87, // 44, 42.80914012
+  0x1d6e2f8c, // 45, 41.38651832
+  0x1c63ae76, // 46, 39.92256684
+  0x1b50c478, // 47, 38.41241892
+  0x1a34622c, // 48, 36.85025108
+  0x190d3e35, // 49, 35.22899598
+  0x17d9c23b, // 50, 33.53993436
+  0x1697ef0a, // 51, 31.77209708
+  0x15453243, // 52, 29.91135686
+  0x13de232b, // 53, 27.93898710
+  0x125e1228, // 54, 25.82924707
+  0x10be3e9e, // 55, 23.54504487
+  0x0ef448d6, // 56, 21.02939493
+  0x0ceeb54f, // 57, 18.18626357
+  0x0a8b6303, // 58, 14.82817437
+  0x07721754 // 59, 10.47047130
+};
+
+static const unsigned char nl_tab[1025] = {
+  59, // 0.00000
+  59, // 0.08789
+  59, // 0.17578
+  59, // 0.26367
+  59, // 0.35156
+  59, // 0.43945
+  59, // 0.52734
+  59, // 0.61523
+  59, // 0.70312
+  59, // 0.79102
+  59, // 0.87891
+  59, // 0.96680
+  59, // 1.05469
+  59, // 1.14258
+  59, // 1.23047
+  59, // 1.31836
+  59, // 1.40625
+  59, // 1.49414
+  59, // 1.58203
+  59, // 1.66992
+  59, // 1.75781
+  59, // 1.84570
+  59, // 1.93359
+  59, // 2.02148
+  59, // 2.10938
+  59, // 2.19727
+  59, // 2.28516
+  59, // 2.37305
+  59, // 2.46094
+  59, // 2.54883
+  59, // 2.63672
+  59, // 2.72461
+  59, // 2.81250
+  59, // 2.90039
+  59, // 2.98828
+  59, // 3.07617
+  59, // 3.16406
+  59, // 3.25195
+  59, // 3.33984
+  59, // 3.42773
+  59, // 3.51562
+  59, // 3.60352
+  59, // 3.69141
+  59, // 3.77930
+  59, // 3.86719
+  59, // 3.95508
+  59, // 4.04297
+  59, // 4.13086
+  59, // 4.21875
+  59, // 4.30664
+  59, // 4.39453
+  59, // 4.48242
+  59, // 4.57031
+  59, // 4.65820
+  59, // 4.74609
+  59, // 4.83398
+  59, // 4.92188
+  59, // 5.00977
+  59, // 5.09766
+  59, // 5.18555
+  59, // 5.27344
+  59, // 5.36133
+  59, // 5.44922
+  59, // 5.53711
+  59, // 5.62500
+  59, // 5.71289
+  59, // 5.80078
+  59, // 5.88867
+  59, // 5.97656
+  59, // 6.06445
+  59, // 6.15234
+  59, // 6.24023
+  59, // 6.32812
+  59, // 6.41602
+  59, // 6.50391
+  59, // 6.59180
+  59, // 6.67969
+  59, // 6.76758
+  59, // 6.85547
+  59, // 6.94336
+  59, // 7.03125
+  59, // 7.11914
+  59, // 7.20703
+  59, // 7.29492
+  59, // 7.38281
+  59, // 7.47070
+  59, // 7.55859
+  59, // 7.64648
+  59, // 7.73438
+  59, // 7.82227
+  59, // 7.91016
+  59, // 7.99805
+  59, // 8.08594
+  59, // 8.17383
+  59, // 8.26172
+  59, // 8.34961
+  59, // 8.43750
+  59, // 8.52539
+  59, // 8.61328
+  59, // 8.70117
+  59, // 8.78906
+  59, // 8.87695
+  59, // 8.96484
+  59, // 9.05273
+  59, // 9.14062
+  59, // 9.22852
+  59, // 9.31641
+  59, // 9.40430
+  59, // 9.49219
+  59, // 9.58008
+  59, // 9.66797
+  59, // 9.75586
+  59, // 9.84375
+  59, // 9.93164
+  59, // 10.01953
+  59, // 10.10742
+  59, // 10.19531
+  59, // 10.28320
+  59, // 10.37109
+  59, // 10.45898
+  58, // 10.54688
+  58, // 10.63477
+  58, // 10.72266
+  58, // 10.81055
+  58, // 10.89844
+  58, // 10.98633
+  58, // 11.07422
+  58, // 11.16211
+  58, // 11.25000
+  58, // 11.33789
+  58, // 11.42578
+  58, // 11.51367
+  58, // 11.60156
+  58, // 11.68945
+  58, // 11.77734
+  58, // 11.86523
+  58, // 11.95312
+  58, // 12.04102
+  58, // 12.12891
+  58, // 12.21680
+  58, // 12.30469
+  58, // 12.39258
+  58, // 12.48047
+  58, // 12.56836
+  58, // 12.65625
+  58, // 12.74414
+  58, // 12.83203
+  58, // 12.91992
+  58, // 13.00781
+  58, // 13.09570
+  58, // 13.18359
+  58, // 13.27148
+  58, // 13.35938
+  58, // 13.44727
+  58, // 13.53516
+  58, // 13.62305
+  58, // 13.71094
+  58, // 13.79883
+  58, // 13.88672
+  58, // 13.97461
+  58, // 14.06250
+  58, // 14.15039
+  58, // 14.23828
+  58, // 14.32617
+  58, // 14.41406
+  58, // 14.50195
+  58, // 14.58984
+  58, // 14.67773
+  58, // 14.76562
+  57, // 14.85352
+  57, // 14.94141
+  57, // 15.02930
+  57, // 15.11719
+  57, // 15.20508
+  57, // 15.29297
+  57, // 15.38086
+  57, // 15.46875
+  57, // 15.55664
+  57, // 15.64453
+  57, // 15.73242
+  57, // 15.82031
+  57, // 15.90820
+  57, // 15.99609
+  57, // 16.08398
+  57, // 16.17188
+  57, // 16.25977
+  57, // 16.34766
+  57, // 16.43555
+  57, // 16.52344
+  57, // 16.61133
+  57, // 16.69922
+  57, // 16.78711
+  57, // 16.87500
+  57, // 16.96289
+  57, // 17.05078
+  57, // 17.13867
+  57, // 17.22656
+  57, // 17.31445
+  57, // 17.40234
+  57, // 17.49023
+  57, // 17.57812
+  57, // 17.66602
+  57, // 17.75391
+  57, // 17.84180
+  57, // 17.92969
+  57, // 18.01758
+  57, // 18.10547
+  56, // 18.19336
+  56, // 18.28125
+  56, // 18.36914
+  56, // 18.45703
+  56, // 18.54492
+  56, // 18.63281
+  56, // 18.72070
+  56, // 18.80859
+  56, // 18.89648
+  56, // 18.98438
+  56, // 19.07227
+  56, // 19.16016
+  56, // 19.24805
+  56, // 19.33594
+  56, // 19.42383
+  56, // 19.51172
+  56, // 19.59961
+  56, // 19.68750
+  56, // 19.77539
+  56, // 19.86328
+  56, // 19.95117
+  56, // 20.03906
+  56, // 20.12695
+  56, // 20.21484
+  56, // 20.30273
+  56, // 20.39062
+  56, // 20.47852
+  56, // 20.56641
+  56, // 20.65430
+  56, // 20.74219
+  56, // 20.83008
+  56, // 20.91797
+  56, // 21.00586
+  55, // 21.09375
+  55, // 21.18164
+  55, // 21.26953
+  55, // 21.35742
+  55, // 21.44531
+  55, // 21.53320
+  55, // 21.62109
+  55, // 21.70898
+  55, // 21.79688
+  55, // 21.88477
+  55, // 21.97266
+  55, // 22.06055
+  55, // 22.14844
+  55, // 22.23633
+  55, // 22.32422
+  55, // 22.41211
+  55, // 22.50000
+  55, // 22.58789
+  55, // 22.67578
+  55, // 22.76367
+  55, // 22.85156
+  55, // 22.93945
+  55, // 23.02734
+  55, // 23.11523
+  55, // 23.20312
+  55, // 23.29102
+  55, // 23.37891
+  55, // 23.46680
+  54, // 23.55469
+  54, // 23.64258
+  54, // 23.73047
+  54, // 23.81836
+  54, // 23.90625
+  54, // 23.99414
+  54, // 24.08203
+  54, // 24.16992
+  54, // 24.25781
+  54, // 24.34570
+  54, // 24.43359
+  54, // 24.52148
+  54, // 24.60938
+  54, // 24.69727
+  54, // 24.78516
+  54, // 24.87305
+  54, // 24.96094
+  54, // 25.04883
+  54, // 25.13672
+  54, // 25.22461
+  54, // 25.31250
+  54, // 25.40039
+  54, // 25.48828
+  54, // 25.57617
+  54, // 25.66406
+  54, // 25.75195
+  53, // 25.83984
+  53, // 25.92773
+  53, // 26.01562
+  53, // 26.10352
+  53, // 26.19141
+  53, // 26.27930
+  53, // 26.36719
+  53, // 26.45508
+  53, // 26.54297
+  53, // 26.63086
+  53, // 26.71875
+  53, // 26.80664
+  53, // 26.89453
+  53, // 26.98242
+  53, // 27.07031
+  53, // 27.15820
+  53, // 27.24609
+  53, // 27.33398
+  53, // 27.42188
+  53, // 27.50977
+  53, // 27.59766
+  53, // 27.68555
+  53, // 27.77344
+  53, // 27.86133
+  52, // 27.94922
+  52, // 28.03711
+  52, // 28.12500
+  52, // 28.21289
+  52, // 28.30078
+  52, // 28.38867
+  52, // 28.47656
+  52, // 28.56445
+  52, // 28.65234
+  52, // 28.74023
+  52, // 28.82812
+  52, // 28.91602
+  52, // 29.00391
+  52, // 29.09180
+  52, // 29.17969
+  52, // 29.26758
+  52, // 29.35547
+  52, // 29.44336
+  52, // 29.53125
+  52, // 29.61914
+  52, // 29.70703
+  52, // 29.79492
+  52, // 29.88281
+  51, // 29.97070
+  51, // 30.05859
+  51, // 30.14648
+  51, // 30.23438
+  51, // 30.32227
+  51, // 30.41016
+  51, // 30.49805
+  51, // 30.58594
+  51, // 30.67383
+  51, // 30.76172
+  51, // 30.84961
+  51, // 30.93750
+  51, // 31.02539
+  51, // 31.11328
+  51, // 31.20117
+  51, // 31.28906
+  51, // 31.37695
+  51, // 31.46484
+  51, // 31.55273
+  51, // 31.64062
+  51, // 31.72852
+  50, // 31.81641
+  50, // 31.90430
+  50, // 31.99219
+  50, // 32.08008
+  50, // 32.16797
+  50, // 32.25586
+  50, // 32.34375
+  50, // 32.43164
+  50, // 32.51953
+  50, // 32.60742
+  50, // 32.69531
+  50, // 32.78320
+  50, // 32.87109
+  50, // 32.95898
+  50, // 33.04688
+  50, // 33.13477
+  50, // 33.22266
+  50, // 33.31055
+  50, // 33.39844
+  50, // 33.48633
+  49, // 33.57422
+  49, // 33.66211
+  49, // 33.75000
+  49, // 33.83789
+  49, // 33.92578
+  49, // 34.01367
+  49, // 34.10156
+  49, // 34.18945
+  49, // 34.27734
+  49, // 34.36523
+  49, // 34.45312
+  49, // 34.54102
+  49, // 34.62891
+  49, // 34.71680
+  49, // 34.80469
+  49, // 34.89258
+  49, // 34.98047
+  49, // 35.06836
+  49, // 35.15625
+  48, // 35.24414
+  48, // 35.33203
+  48, // 35.41992
+  48, // 35.50781
+  48, // 35.59570
+  48, // 35.68359
+  48, // 35.77148
+  48, // 35.85938
+  48, // 35.94727
+  48, // 36.03516
+  48, // 36.12305
+  48, // 36.21094
+  48, // 36.29883
+  48, // 36.38672
+  48, // 36.47461
+  48, // 36.56250
+  48, // 36.65039
+  48, // 36.73828
+  48, // 36.82617
+  47, // 36.91406
+  47, // 37.00195
+  47, // 37.08984
+  47, // 37.17773
+  47, // 37.26562
+  47, // 37.35352
+  47, // 37.44141
+  47, // 37.52930
+  47, // 37.61719
+  47, // 37.70508
+  47, // 37.79297
+  47, // 37.88086
+  47, // 37.96875
+  47, // 38.05664
+  47, // 38.14453
+  47, // 38.23242
+  47, // 38.32031
+  47, // 38.40820
+  46, // 38.49609
+  46, // 38.58398
+  46, // 38.67188
+  46, // 38.75977
+  46, // 38.84766
+  46, // 38.93555
+  46, // 39.02344
+  46, // 39.11133
+  46, // 39.19922
+  46, // 39.28711
+  46, // 39.37500
+  46, // 39.46289
+  46, // 39.55078
+  46, // 39.63867
+  46, // 39.72656
+  46, // 39.81445
+  46, // 39.90234
+  45, // 39.99023
+  45, // 40.07812
+  45, // 40.16602
+  45, // 40.25391
+  45, // 40.34180
+  45, // 40.42969
+  45, // 40.51758
+  45, // 40.60547
+  45, // 40.69336
+  45, // 40.78125
+  45, // 40.86914
+  45, // 40.95703
+  45, // 41.04492
+  45, // 41.13281
+  45, // 41.22070
+  45, // 41.30859
+  44, // 41.39648
+  44, // 41.48438
+  44, // 41.57227
+  44, // 41.66016
+  44, // 41.74805
+  44, // 41.83594
+  44, // 41.92383
+  44, // 42.01172
+  44, // 42.09961
+  44, // 42.18750
+  44, // 42.27539
+  44, // 42.36328
+  44, // 42.45117
+  44, // 42.53906
+  44, // 42.62695
+  44, // 42.71484
+  44, // 42.80273
+  43, // 42.89062
+  43, // 42.97852
+  43, // 43.06641
+  43, // 43.15430
+  43, // 43.24219
+  43, // 43.33008
+  43, // 43.41797
+  43, // 43.50586
+  43, // 43.59375
+  43, // 43.68164
+  43, // 43.76953
+  43, // 43.85742
+  43, // 43.94531
+  43, // 44.03320
+  43, // 44.12109
+  42, // 44.20898
+  42, // 44.29688
+  42, // 44.38477
+  42, // 44.47266
+  42, // 44.56055
+  42, // 44.64844
+  42, // 44.73633
+  42, // 44.82422
+  42, // 44.91211
+  42, // 45.00000
+  42, // 45.08789
+  42, // 45.17578
+  42, // 45.26367
+  42, // 45.35156
+  42, // 45.43945
+  42, // 45.52734
+  41, // 45.61523
+  41, // 45.70312
+  41, // 45.79102
+  41, // 45.87891
+  41, // 45.96680
+  41, // 46.05469
+  41, // 46.14258
+  41, // 46.23047
+  41, // 46.31836
+  41, // 46.40625
+  41, // 46.49414
+  41, // 46.58203
+  41, // 46.66992
+  41, // 46.75781
+  41, // 46.84570
+  40, // 46.93359
+  40, // 47.02148
+  40, // 47.10938
+  40, // 47.19727
+  40, // 47.28516
+  40, // 47.37305
+  40, // 47.46094
+  40, // 47.54883
+  40, // 47.63672
+  40, // 47.72461
+  40, // 47.81250
+  40, // 47.90039
+  40, // 47.98828
+  40, // 48.07617
+  39, // 48.16406
+  39, // 48.25195
+  39, // 48.33984
+  39, // 48.42773
+  39, // 48.51562
+  39, // 48.60352
+  39, // 48.69141
+  39, // 48.77930
+  39, // 48.86719
+  39, // 48.95508
+  39, // 49.04297
+  39, // 49.13086
+  39, // 49.21875
+  39, // 49.30664
+  39, // 49.39453
+  38, // 49.48242
+  38, // 49.57031
+  38, // 49.65820
+  38, // 49.74609
+  38, // 49.83398
+  38, // 49.92188
+  38, // 50.00977
+  38, // 50.09766
+  38, // 50.18555
+  38, // 50.27344
+  38, // 50.36133
+  38, // 50.44922
+  38, // 50.53711
+  38, // 50.62500
+  37, // 50.71289
+  37, // 50.80078
+  37, // 50.88867
+  37, // 50.97656
+  37, // 51.06445
+  37, // 51.15234
+  37, // 51.24023
+  37, // 51.32812
+  37, // 51.41602
+  37, // 51.50391
+  37, // 51.59180
+  37, // 51.67969
+  37, // 51.76758
+  37, // 51.85547
+  36, // 51.94336
+  36, // 52.03125
+  36, // 52.11914
+  36, // 52.20703
+  36, // 52.29492
+  36, // 52.38281
+  36, // 52.47070
+  36, // 52.55859
+  36, // 52.64648
+  36, // 52.73438
+  36, // 52.82227
+  36, // 52.91016
+  36, // 52.99805
+  36, // 53.08594
+  35, // 53.17383
+  35, // 53.26172
+  35, // 53.34961
+  35, // 53.43750
+  35, // 53.52539
+  35, // 53.61328
+  35, // 53.70117
+  35, // 53.78906
+  35, // 53.87695
+  35, // 53.96484
+  35, // 54.05273
+  35, // 54.14062
+  35, // 54.22852
+  34, // 54.31641
+  34, // 54.40430
+  34, // 54.49219
+  34, // 54.58008
+  34, // 54.66797
+  34, // 54.75586
+  34, // 54.84375
+  34, // 54.93164
+  34, // 55.01953
+  34, // 55.10742
+  34, // 55.19531
+  34, // 55.28320
+  34, // 55.37109
+  33, // 55.45898
+  33, // 55.54688
+  33, // 55.63477
+  33, // 55.72266
+  33, // 55.81055
+  33, // 55.89844
+  33, // 55.98633
+  33, // 56.07422
+  33, // 56.16211
+  33, // 56.25000
+  33, // 56.33789
+  33, // 56.42578
+  33, // 56.51367
+  32, // 56.60156
+  32, // 56.68945
+  32, // 56.77734
+  32, // 56.86523
+  32, // 56.95312
+  32, // 57.04102
+  32, // 57.12891
+  32, // 57.21680
+  32, // 57.30469
+  32, // 57.39258
+  32, // 57.48047
+  32, // 57.56836
+  32, // 57.65625
+  31, // 57.74414
+  31, // 57.83203
+  31, // 57.91992
+  31, // 58.00781
+  31, // 58.09570
+  31, // 58.18359
+  31, // 58.27148
+  31, // 58.35938
+  31, // 58.44727
+  31, // 58.53516
+  31, // 58.62305
+  31, // 58.71094
+  31, // 58.79883
+  30, // 58.88672
+  30, // 58.97461
+  30, // 59.06250
+  30, // 59.15039
+  30, // 59.23828
+  30, // 59.32617
+  30, // 59.41406
+  30, // 59.50195
+  30, // 59.58984
+  30, // 59.67773
+  30, // 59.76562
+  30, // 59.85352
+  30, // 59.94141
+  29, // 60.02930
+  29, // 60.11719
+  29, // 60.20508
+  29, // 60.29297
+  29, // 60.38086
+  29, // 60.46875
+  29, // 60.55664
+  29, // 60.64453
+  29, // 60.73242
+  29, // 60.82031
+  29, // 60.90820
+  29, // 60.99609
+  28, // 61.08398
+  28, // 61.17188
+  28, // 61.25977
+  28, // 61.34766
+  28, // 61.43555
+  28, // 61.52344
+  28, // 61.61133
+  28, // 61.69922
+  28, // 61.78711
+  28, // 61.87500
+  28, // 61.96289
+  28, // 62.05078
+  27, // 62.13867
+  27, // 62.22656
+  27, // 62.31445
+  27, // 62.40234
+  27, // 62.49023
+  27, // 62.57812
+  27, // 62.66602
+  27, // 62.75391
+  27, // 62.84180
+  27, // 62.92969
+  27, // 63.01758
+  27, // 63.10547
+  27, // 63.19336
+  26, // 63.28125
+  26, // 63.36914
+  26, // 63.45703
+  26, // 63.54492
+  26, // 63.63281
+  26, // 63.72070
+  26, // 63.80859
+  26, // 63.89648
+  26, // 63.98438
+  26, // 64.07227
+  26, // 64.16016
+  26, // 64.24805
+  25, // 64.33594
+  25, // 64.42383
+  25, // 64.51172
+  25, // 64.59961
+  25, // 64.68750
+  25, // 64.77539
+  25, // 64.86328
+  25, // 64.95117
+  25, // 65.03906
+  25, // 65.12695
+  25, // 65.21484
+  25, // 65.30273
+  24, // 65.39062
+  24, // 65.47852
+  24, // 65.56641
+  24, // 65.65430
+  24, // 65.74219
+  24, // 65.83008
+  24, // 65.91797
+  24, // 66.00586
+  24, // 66.09375
+  24, // 66.18164
+  24, // 66.26953
+  24, // 66.35742
+  23, // 66.44531
+  23, // 66.53320
+  23, // 66.62109
+  23, // 66.70898
+  23, // 66.79688
+  23, // 66.88477
+  23, // 66.97266
+  23, // 67.06055
+  23, // 67.14844
+  23, // 67.23633
+  23, // 67.32422
+  22, // 67.41211
+  22, // 67.50000
+  22, // 67.58789
+  22, // 67.67578
+  22, // 67.76367
+  22, // 67.85156
+  22, // 67.93945
+  22, // 68.02734
+  22, // 68.11523
+  22, // 68.20312
+  22, // 68.29102
+  22, // 68.37891
+  21, // 68.46680
+  21, // 68.55469
+  21, // 68.64258
+  21, // 68.73047
+  21, // 68.81836
+  21, // 68.90625
+  21, // 68.99414
+  21, // 69.08203
+  21, // 69.16992
+  21, // 69.25781
+  21, // 69.34570
+  21, // 69.43359
+  20, // 69.52148
+  20, // 69.60938
+  20, // 69.69727
+  20, // 69.78516
+  20, // 69.87305
+  20, // 69.96094
+  20, // 70.04883
+  20, // 70.13672
+  20, // 70.22461
+  20, // 70.31250
+  20, // 70.40039
+  19, // 70.48828
+  19, // 70.57617
+  19, // 70.66406
+  19, // 70.75195
+  19, // 70.83984
+  19, // 70.92773
+  19, // 71.01562
+  19, // 71.10352
+  19, // 71.19141
+  19, // 71.27930
+  19, // 71.36719
+  19, // 71.45508
+  18, // 71.54297
+  18, // 71.63086
+  18, // 71.71875
+  18, // 71.80664
+  18, // 71.89453
+  18, // 71.98242
+  18, // 72.07031
+  18, // 72.15820
+  18, // 72.24609
+  18, // 72.33398
+  18, // 72.42188
+  17, // 72.50977
+  17, // 72.59766
+  17, // 72.68555
+  17, // 72.77344
+  17, // 72.86133
+  17, // 72.94922
+  17, // 73.03711
+  17, // 73.12500
+  17, // 73.21289
+  17, // 73.30078
+  17, // 73.38867
+  16, // 73.47656
+  16, // 73.56445
+  16, // 73.65234
+  16, // 73.74023
+  16, // 73.82812
+  16, // 73.91602
+  16, // 74.00391
+  16, // 74.09180
+  16, // 74.17969
+  16, // 74.26758
+  16, // 74.35547
+  15, // 74.44336
+  15, // 74.53125
+  15, // 74.61914
+  15, // 74.70703
+  15, // 74.79492
+  15, // 74.88281
+  15, // 74.97070
+  15, // 75.05859
+  15, // 75.14648
+  15, // 75.23438
+  15, // 75.32227
+  15, // 75.41016
+  14, // 75.49805
+  14, // 75.58594
+  14, // 75.67383
+  14, // 75.76172
+  14, // 75.84961
+  14, // 75.93750
+  14, // 76.02539
+  14, // 76.11328
+  14, // 76.20117
+  14, // 76.28906
+  14, // 76.37695
+  13, // 76.46484
+  13, // 76.55273
+  13, // 76.64062
+  13, // 76.72852
+  13, // 76.81641
+  13, // 76.90430
+  13, // 76.99219
+  13, // 77.08008
+  13, // 77.16797
+  13, // 77.25586
+  13, // 77.34375
+  12, // 77.43164
+  12, // 77.51953
+  12, // 77.60742
+  12, // 77.69531
+  12, // 77.78320
+  12, // 77.87109
+  12, // 77.95898
+  12, // 78.04688
+  12, // 78.13477
+  12, // 78.22266
+  12, // 78.31055
+  11, // 78.39844
+  11, // 78.48633
+  11, // 78.57422
+  11, // 78.66211
+  11, // 78.75000
+  11, // 78.83789
+  11, // 78.92578
+  11, // 79.01367
+  11, // 79.10156
+  11, // 79.18945
+  11, // 79.27734
+  10, // 79.36523
+  10, // 79.45312
+  10, // 79.54102
+  10, // 79.62891
+  10, // 79.71680
+  10, // 79.80469
+  10, // 79.89258
+  10, // 79.98047
+  10, // 80.06836
+  10, // 80.15625
+  10, // 80.24414
+   9, // 80.33203
+   9, // 80.41992
+   9, // 80.50781
+   9, // 80.59570
+   9, // 80.68359
+   9, // 80.77148
+   9, // 80.85938
+   9, // 80.94727
+   9, // 81.03516
+   9, // 81.12305
+   8, // 81.21094
+   8, // 81.29883
+   8, // 81.38672
+   8, // 81.47461
+   8, // 81.56250
+   8, // 81.65039
+   8, // 81.73828
+   8, // 81.82617
+   8, // 81.91406
+   8, // 82.00195
+   8, // 82.08984
+   7, // 82.17773
+   7, // 82.26562
+   7, // 82.35352
+   7, // 82.44141
+   7, // 82.52930
+   7, // 82.61719
+   7, // 82.70508
+   7, // 82.79297
+   7, // 82.88086
+   7, // 82.96875
+   7, // 83.05664
+   6, // 83.14453
+   6, // 83.23242
+   6, // 83.32031
+   6, // 83.40820
+   6, // 83.49609
+   6, // 83.58398
+   6, // 83.67188
+   6, // 83.75977
+   6, // 83.84766
+   6, // 83.93555
+   5, // 84.02344
+   5, // 84.11133
+   5, // 84.19922
+   5, // 84.28711
+   5, // 84.37500
+   5, // 84.46289
+   5, // 84.55078
+   5, // 84.63867
+   5, // 84.72656
+   5, // 84.81445
+   4, // 84.90234
+   4, // 84.99023
+   4, // 85.07812
+   4, // 85.16602
+   4, // 85.25391
+   4, // 85.34180
+   4, // 85.42969
+   4, // 85.51758
+   4, // 85.60547
+   4, // 85.69336
+   3, // 85.78125
+   3, // 85.86914
+   3, // 85.95703
+   3, // 86.04492
+   3, // 86.13281
+   3, // 86.22070
+   3, // 86.30859
+   3, // 86.39648
+   3, // 86.48438
+   2, // 86.57227
+   2, // 86.66016
+   2, // 86.74805
+   2, // 86.83594
+   2, // 86.92383
+   1, // 87.01172
+   1, // 87.09961
+   1, // 87.18750
+   1, // 87.27539
+   1, // 87.36328
+   1, // 87.45117
+   1, // 87.53906
+   1, // 87.62695
+   1, // 87.71484
+   1, // 87.80273
+   1, // 87.89062
+   1, // 87.97852
+   1, // 88.06641
+   1, // 88.15430
+   1, // 88.24219
+   1, // 88.33008
+   1, // 88.41797
+   1, // 88.50586
+   1, // 88.59375
+   1, // 88.68164
+   1, // 88.76953
+   1, // 88.85742
+   1, // 88.94531
+   1, // 89.03320
+   1, // 89.12109
+   1, // 89.20898
+   1, // 89.29688
+   1, // 89.38477
+   1, // 89.47266
+   1, // 89.56055
+   1, // 89.64844
+   1, // 89.73633
+   1, // 89.82422
+   1, // 89.91211
+   1 // 90.00000
+};
+
+#define ATAN_N  256
+
+static const unsigned short atan_tab[257] = {
+     0, // 0/256
+    22, // 1/256
+    45, // 2/256
+    67, // 3/256
+    90, // 4/256
+   112, // 5/256
+   134, // 6/256
+   157, // 7/256
+   179, // 8/256
+   201, // 9/256
+   224, // 10/256
+   246, // 11/256
+   268, // 12/256
+   291, // 13/256
+   313, // 14/256
+   335, // 15/256
+   358, // 16/256
+   380, // 17/256
+   402, // 18/256
+   424, // 19/256
+   447, // 20/256
+   469, // 21/256
+   491, // 22/256
+   513, // 23/256
+   536, // 24/256
+   558, // 25/256
+   580, // 26/256
+   602, // 27/256
+   624, // 28/256
+   646, // 29/256
+   668, // 30/256
+   690, // 31/256
+   713, // 32/256
+   735, // 33/256
+   757, // 34/256
+   779, // 35/256
+   800, // 36/256
+   822, // 37/256
+   844, // 38/256
+   866, // 39/256
+   888, // 40/256
+   910, // 41/256
+   932, // 42/256
+   953, // 43/256
+   975, // 44/256
+   997, // 45/256
+  1019, // 46/256
+  1040, // 47/256
+  1062, // 48/256
+  1084, // 49/256
+  1105, // 50/256
+  1127, // 51/256
+  1148, // 52/256
+  1170, // 53/256
+  1191, // 54/256
+  1213, // 55/256
+  1234, // 56/256
+  1255, // 57/256
+  1277, // 58/256
+  1298, // 59/256
+  1319, // 60/256
+  1340, // 61/256
+  1361, // 62/256
+  1383, // 63/256
+  1404, // 64/256
+  1425, // 65/256
+  1446, // 66/256
+  1467, // 67/256
+  1488, // 68/256
+  1508, // 69/256
+  1529, // 70/256
+  1550, // 71/256
+  1571, // 72/256
+  1592, // 73/256
+  1612, // 74/256
+  1633, // 75/256
+  1653, // 76/256
+  1674, // 77/256
+  1695, // 78/256
+  1715, // 79/256
+  1735, // 80/256
+  1756, // 81/256
+  1776, // 82/256
+  1796, // 83/256
+  1817, // 84/256
+  1837, // 85/256
+  1857, // 86/256
+  1877, // 87/256
+  1897, // 88/256
+  1917, // 89/256
+  1937, // 90/256
+  1957, // 91/256
+  1977, // 92/256
+  1997, // 93/256
+  2016, // 94/256
+  2036, // 95/256
+  2056, // 96/256
+  2075, // 97/256
+  2095, // 98/256
+  2114, // 99/256
+  2134, // 100/256
+  2153, // 101/256
+  2172, // 102/256
+  2192, // 103/256
+  2211, // 104/256
+  2230, // 105/256
+  2249, // 106/256
+  2268, // 107/256
+  2287, // 108/256
+  2306, // 109/256
+  2325, // 110/256
+  2344, // 111/256
+  2363, // 112/256
+  2382, // 113/256
+  2400, // 114/256
+  2419, // 115/256
+  2438, // 116/256
+  2456, // 117/256
+  2475, // 118/256
+  2493, // 119/256
+  2511, // 120/256
+  2530, // 121/256
+  2548, // 122/256
+  2566, // 123/256
+  2584, // 124/256
+  2603, // 125/256
+  2621, // 126/256
+  2639, // 127/256
+  2657, // 128/256
+  2674, // 129/256
+  2692, // 130/256
+  2710, // 131/256
+  2728, // 132/256
+  2745, // 133/256
+  2763, // 134/256
+  2780, // 135/256
+  2798, // 136/256
+  2815, // 137/256
+  2833, // 138/256
+  2850, // 139/256
+  2867, // 140/256
+  2885, // 141/256
+  2902, // 142/256
+  2919, // 143/256
+  2936, // 144/256
+  2953, // 145/256
+  2970, // 146/256
+  2987, // 147/256
+  3003, // 148/256
+  3020, // 149/256
+  3037, // 150/256
+  3053, // 151/256
+  3070, // 152/256
+  3086, // 153/256
+  3103, // 154/256
+  3119, // 155/256
+  3136, // 156/256
+  3152, // 157/256
+  3168, // 158/256
+  3184, // 159/256
+  3201, // 160/256
+  3217, // 161/256
+  3233, // 162/256
+  3249, // 163/256
+  3264, // 164/256
+  3280, // 165/256
+  3296, // 166/256
+  3312, // 167/256
+  3327, // 168/256
+  3343, // 169/256
+  3359, // 170/256
+  3374, // 171/256
+  3390, // 172/256
+  3405, // 173/256
+  3420, // 174/256
+  3436, // 175/256
+  3451, // 176/256
+  3466, // 177/256
+  3481, // 178/256
+  3496, // 179/256
+  3511, // 180/256
+  3526, // 181/256
+  3541, // 182/256
+  3556, // 183/256
+  3571, // 184/256
+  3585, // 185/256
+  3600, // 186/256
+  3615, // 187/256
+  3629, // 188/256
+  3644, // 189/256
+  3658, // 190/256
+  3673, // 191/256
+  3687, // 192/256
+  3701, // 193/256
+  3716, // 194/256
+  3730, // 195/256
+  3744, // 196/256
+  3758, // 197/256
+  3772, // 198/256
+  3786, // 199/256
+  3800, // 200/256
+  3814, // 201/256
+  3828, // 202/256
+  3841, // 203/256
+  3855, // 204/256
+  3869, // 205/256
+  3882, // 206/256
+  3896, // 207/256
+  3909, // 208/256
+  3923, // 209/256
+  3936, // 210/256
+  3950, // 211/256
+  3963, // 212/256
+  3976, // 213/256
+  3989, // 214/256
+  4003, // 215/256
+  4016, // 216/256
+  4029, // 217/256
+  4042, // 218/256
+  4055, // 219/256
+  4067, // 220/256
+  4080, // 221/256
+  4093, // 222/256
+  4106, // 223/256
+  4119, // 224/256
+  4131, // 225/256
+  4144, // 226/256
+  4156, // 227/256
+  4169, // 228/256
+  4181, // 229/256
+  4194, // 230/256
+  4206, // 231/256
+  4218, // 232/256
+  4231, // 233/256
+  4243, // 234/256
+  4255, // 235/256
+  4267, // 236/256
+  4279, // 237/256
+  4291, // 238/256
+  4303, // 239/256
+  4315, // 240/256
+  4327, // 241/256
+  4339, // 242/256
+  4351, // 243/256
+  4363, // 244/256
+  4374, // 245/256
+  4386, // 246/256
+  4397, // 247/256
+  4409, // 248/256
+  4421, // 249/256
+  4432, // 250/256
+  4443, // 251/256
+  4455, // 252/256
+  4466, // 253/256
+  4478, // 254/256
+  4489, // 255/256
+  4500 // 256/256
+};
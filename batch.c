@@ -0,0 +1,384 @@
+/*
+ * The offline decoder of recordings
+ *
+ * The recording is mapped and cut into shards, which several threads
+ * decode at once. Every shard starts a bit early, so that the decoder
+ * sees the frames that straddle the cut, but only delivers the ones whose
+ * preambles fall into the shard. The main thread writes the frames out
+ * shard by shard, so the output is in the order of time, as if one
+ * decoder went through the whole file. The address cache and the repeats
+ * need that order, so the writer takes care of them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "crc.h"
+#include "icao.h"
+#include "out.h"
+#include "upd.h"
+#include "yoga.h"
+
+#define TAG "batch_yoga"
+
+#define BLK     131072		// the transfer of libairspy, for the DC bias
+#define SHARD   (512*BLK)	// 3.4 s at 20 Ms/s
+#define AHEAD   4		// shards that a thread may decode ahead
+#define WMAX    256
+
+struct frame {
+	uint64_t ts;		// sample index of the preamble
+	int level;
+	int clean;		// for dec_addr()
+	unsigned int len;	// in bytes
+	unsigned char b[112/8];
+};
+
+struct shard {
+	struct frame *vec;
+	unsigned long cnt, max;
+	int done;
+};
+
+struct worker {
+	struct rstate rs;
+	struct shard *cur;
+	pthread_t thread;
+};
+
+static const struct dvar *var;
+static const unsigned char *base;
+static unsigned long total;		// samples in the file
+static int short_ok;
+
+static struct worker *wv;
+static int nwork;
+
+static struct shard *shv;
+static unsigned long nshard;
+static unsigned long shard_next;	// the next one to take
+static unsigned long shard_out;		// the next one to write
+static pthread_mutex_t shard_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shard_cond = PTHREAD_COND_INITIALIZER;
+
+static struct out out;
+
+static void Usage(void) {
+	fprintf(stderr,
+	    "Usage: batch_yoga [-t threads] [-R 20|12|10] [-f avr|avrt|beast]"
+	    " [-S] [-F 0|1|2] [-K 0|1|2|3] [-D usec] file.raw\n");
+	exit(1);
+}
+
+static void batch_deliver(struct rstate *rsp)
+{
+	struct shard *sp = container_of(rsp, struct worker, rs)->cur;
+	struct frame *fp;
+
+	// The short ones that fill the address cache go to the writer.
+	if (rsp->data_len < 112 && !short_ok && !rsp->clean)
+		return;
+
+	if (sp->cnt == sp->max) {
+		sp->max = sp->max ? sp->max * 2 : 1024;
+		fp = realloc(sp->vec, sp->max * sizeof(struct frame));
+		if (fp == NULL) {
+			fprintf(stderr, TAG ": No core\n");
+			exit(1);
+		}
+		sp->vec = fp;
+	}
+	fp = &sp->vec[sp->cnt++];
+	fp->ts = rsp->pre_n;
+	fp->level = rsp->pre_level;
+	fp->clean = rsp->clean;
+	fp->len = rsp->data_len / 8;
+	memcpy(fp->b, rsp->packet, fp->len);
+}
+
+/*
+ * Decode the samples [k*SHARD - pre, (k+1)*SHARD) and keep the frames
+ * that start in the shard. A frame that starts near the end belongs to
+ * the next shard, which has it all in its prefix.
+ *
+ * The DC bias follows the grid of transfers from the start of the file,
+ * the same as a live run or a replay would have it.
+ */
+static void batch_shard(struct worker *wp, unsigned long k)
+{
+	struct rstate *rsp = &wp->rs;
+	uint64_t lo, hi, pos, start;
+	unsigned long g, g0;
+	unsigned int n, timer;
+
+	lo = (uint64_t) k * SHARD;
+	hi = (k + 1 == nshard) ? total : lo + SHARD;
+	start = (lo < FRAME_PRE(var)) ? 0 : lo - FRAME_PRE(var);
+
+	if (rsp->clock != start) {
+		rstate_hunt(rsp);
+		rsp->clock = start;
+	}
+	rsp->own_lo = (lo < FRAME_MAX(var)) ? 0 : lo - FRAME_MAX(var);
+	rsp->own_hi = (k + 1 == nshard) ? UINT64_MAX : hi - FRAME_MAX(var);
+	wp->cur = &shv[k];
+
+	g = start / BLK;
+	g0 = g - g % 10;
+	n = (total - g0 * BLK < BLK) ? total - g0 * BLK : BLK;
+	timer = 0;
+	bias_update(&rsp->dc_bias, &timer, base + g0 * BLK * 2, n);
+
+	for (pos = start; pos < hi; pos += n) {
+		g = pos / BLK;
+		n = ((g + 1) * BLK < hi) ? (g + 1) * BLK - pos : hi - pos;
+		if (pos % BLK == 0) {
+			rsp->bias_timer = g % 10;
+			dec_bias(rsp, base + pos * 2, n);
+		}
+		dec_block(rsp, base + pos * 2, n);
+	}
+}
+
+static void *batch_thread(void *arg)
+{
+	struct worker *wp = arg;
+	unsigned long k;
+
+	for (;;) {
+		pthread_mutex_lock(&shard_mutex);
+		while (shard_next < nshard &&
+		    shard_next >= shard_out + AHEAD * nwork)
+			pthread_cond_wait(&shard_cond, &shard_mutex);
+		if (shard_next == nshard) {
+			pthread_mutex_unlock(&shard_mutex);
+			break;
+		}
+		k = shard_next++;
+		pthread_mutex_unlock(&shard_mutex);
+
+		batch_shard(wp, k);
+
+		pthread_mutex_lock(&shard_mutex);
+		shv[k].done = 1;
+		pthread_cond_broadcast(&shard_cond);
+		pthread_mutex_unlock(&shard_mutex);
+	}
+	return NULL;
+}
+
+/*
+ * The threads decode their shards at unrelated times, so the addresses
+ * and the repeats are checked here, in the order of the frames.
+ */
+static unsigned long batch_write(struct shard *sp, struct icao *ic,
+    struct dup1 *dupv, uint64_t win, struct dstats *stp)
+{
+	struct frame *fp;
+	struct ofr fr;
+	unsigned long i, n;
+
+	memset(&fr, 0, sizeof(struct ofr));
+	n = 0;
+	for (i = 0; i < sp->cnt; i++) {
+		fp = &sp->vec[i];
+		if (dec_addr(ic, fp->b, fp->len, fp->clean, fp->ts) != 0) {
+			stp->ap_unknown++;
+			continue;
+		}
+		if (dup_seen(dupv, win, fp->b, fp->len, fp->ts, -1)) {
+			stp->dups++;
+			continue;
+		}
+		if (fp->len < 112/8 && !short_ok)
+			continue;
+		fr.pkt = fp->b;
+		fr.plen = fp->len;
+		fr.ts = ts_mlat(fp->ts, var->srate) & 0xFFFFFFFFFFFFULL;
+		fr.rssi = out_rssi(fp->level);
+		out_frame(&out, &fr);
+		n++;
+	}
+	free(sp->vec);
+	sp->vec = NULL;
+	return n;
+}
+
+int main(int argc, char **argv) {
+	static struct dup1 dupv[1 << DUP_BITS];
+	static struct icao icao;
+	char *raw_name = NULL;
+	enum out_fmt fmt = OUT_AVR_T;
+	struct timespec t0, t1;
+	struct stat st;
+	unsigned long k, frames;
+	struct dstats sum;
+	int fix_bits = 1, soft_bits = SOFT_BITS_MAX;
+	long dup_us = DUP_US;
+	double secs;
+	char *arg;
+	int fd, i;
+
+	var = dvar_find(NULL);
+	nwork = sysconf(_SC_NPROCESSORS_ONLN);
+	argv++;
+	while ((arg = *argv++) != NULL) {
+		if (strcmp(arg, "-t") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			nwork = strtol(arg, NULL, 10);
+			if (nwork < 1 || nwork > WMAX)
+				Usage();
+		} else if (strcmp(arg, "-R") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			var = dvar_find(arg);
+			if (var == NULL)
+				Usage();
+		} else if (strcmp(arg, "-f") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			// The SBS needs the aircraft and the wall clock.
+			if (out_fmt_find(arg, &fmt) != 0 || fmt == OUT_SBS)
+				Usage();
+		} else if (strcmp(arg, "-S") == 0) {
+			short_ok = 1;
+		} else if (strcmp(arg, "-F") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			fix_bits = strtol(arg, NULL, 10);
+			if (fix_bits < 0 || fix_bits > CRC_FIX_MAX)
+				Usage();
+		} else if (strcmp(arg, "-K") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			soft_bits = strtol(arg, NULL, 10);
+			if (soft_bits < 0 || soft_bits > SOFT_BITS_MAX)
+				Usage();
+		} else if (strcmp(arg, "-D") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			dup_us = strtol(arg, NULL, 10);
+			if (dup_us < 0 || dup_us > 1000000)
+				Usage();
+		} else if (arg[0] == '-') {
+			Usage();
+		} else if (raw_name == NULL) {
+			raw_name = arg;
+		} else {
+			Usage();
+		}
+	}
+	if (raw_name == NULL)
+		Usage();
+	if (nwork < 1)
+		nwork = 1;
+	if (nwork > WMAX)
+		nwork = WMAX;
+
+	fd = open(raw_name, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) != 0) {
+		fprintf(stderr, TAG ": Cannot open %s: %s\n",
+		    raw_name, strerror(errno));
+		exit(1);
+	}
+	if (st.st_size < 2) {
+		fprintf(stderr, TAG ": File %s is empty\n", raw_name);
+		exit(1);
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, TAG ": Cannot map %s: %s\n",
+		    raw_name, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+	// Every shard is read once, from the start to the end.
+	madvise((void *) base, st.st_size, MADV_SEQUENTIAL);
+
+	total = st.st_size / 2;
+	nshard = (total + SHARD - 1) / SHARD;
+	shv = calloc(nshard, sizeof(struct shard));
+	wv = calloc(nwork, sizeof(struct worker));
+	if (shv == NULL || wv == NULL) {
+		fprintf(stderr, TAG ": No core\n");
+		exit(1);
+	}
+
+	// The threads leave the addresses and the repeats to batch_write().
+	for (i = 0; i < nwork; i++) {
+		if (rstate_init(&wv[i].rs, var, batch_deliver) != 0) {
+			fprintf(stderr, TAG ": No core\n");
+			exit(1);
+		}
+		wv[i].rs.fix_bits = fix_bits;
+		wv[i].rs.soft_bits = soft_bits;
+		wv[i].rs.dup_win = 0;
+		wv[i].rs.clock = UINT64_MAX;
+	}
+	icao_init(&icao, (uint64_t) ICAO_TTL * var->srate);
+	out_init(&out, 1, fmt);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nwork; i++) {
+		if (pthread_create(&wv[i].thread, NULL, batch_thread,
+		    &wv[i]) != 0) {
+			fprintf(stderr, TAG ": Cannot start a thread\n");
+			exit(1);
+		}
+	}
+
+	frames = 0;
+	memset(&sum, 0, sizeof(struct dstats));
+	for (k = 0; k < nshard; k++) {
+		pthread_mutex_lock(&shard_mutex);
+		while (!shv[k].done)
+			pthread_cond_wait(&shard_cond, &shard_mutex);
+		pthread_mutex_unlock(&shard_mutex);
+
+		frames += batch_write(&shv[k], &icao, dupv,
+		    (uint64_t) dup_us * var->srate / 1000000, &sum);
+		if (out_flush(&out) != 0) {
+			fprintf(stderr, TAG ": Write error: %s\n",
+			    strerror(out.err));
+			exit(1);
+		}
+
+		pthread_mutex_lock(&shard_mutex);
+		shard_out = k + 1;
+		pthread_cond_broadcast(&shard_cond);
+		pthread_mutex_unlock(&shard_mutex);
+	}
+
+	for (i = 0; i < nwork; i++) {
+		pthread_join(wv[i].thread, NULL);
+		sum.errors += wv[i].rs.st.errors;
+		sum.pre_hits += wv[i].rs.st.pre_hits;
+		sum.crc_bad += wv[i].rs.st.crc_bad;
+		sum.crc_fixed += wv[i].rs.st.crc_fixed;
+		sum.crc_soft += wv[i].rs.st.crc_soft;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	fprintf(stderr, "samples %lu shards %lu threads %d"
+	    " secs %.3f Ms/s %.2f\n",
+	    total, nshard, nwork, secs, total / secs / 1e6);
+	fprintf(stderr, "frames %lu errors %lu preambles %lu"
+	    " bad %lu fixed %lu soft %lu unknown %lu dups %lu\n",
+	    frames, sum.errors, sum.pre_hits,
+	    sum.crc_bad, sum.crc_fixed, sum.crc_soft,
+	    sum.ap_unknown, sum.dups);
+
+	munmap((void *) base, st.st_size);
+	return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * Benchmark of the decoder
+ *
+ * Runs a raw recording through the decoder as fast as the CPU allows.
+ * With the truth from test_gen, it also reports how many of the emitted
+ * frames were decoded, and how many decoded frames were never emitted.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "crc.h"
+#include "icao.h"
+#include "upd.h"
+#include "yoga.h"
+
+#define TAG "bench_yoga"
+
+#define BLK  131072
+
+// A decoded frame matches an emitted one if the stamps are this close.
+#define TS_TOL  100
+
+struct frame {
+	unsigned int len;	// in bytes
+	unsigned char b[112/8];
+	uint64_t ts;		// sample index of the preamble
+};
+
+struct fvec {
+	struct frame *vec;
+	unsigned long cnt, max;
+};
+
+static struct rstate rs;
+static struct icao icao;
+static struct fvec decoded, emitted;
+static long ts_min, ts_max, ts_sum;	// decoded minus emitted timestamps
+
+static void Usage(void) {
+	fprintf(stderr,
+	    "Usage: bench_yoga [-b NNNN] [-R 20|12|10] [-m scan|mask|ring]"
+	    " [-F 0|1|2] [-K 0|1|2|3] [-D usec]"
+	    " file.raw [truth]\n");
+	exit(1);
+}
+
+static struct frame *fvec_add(struct fvec *fv)
+{
+	struct frame *p;
+
+	if (fv->cnt == fv->max) {
+		fv->max = fv->max ? fv->max * 2 : 1024;
+		p = realloc(fv->vec, fv->max * sizeof(struct frame));
+		if (p == NULL) {
+			fprintf(stderr, TAG ": No core\n");
+			exit(1);
+		}
+		fv->vec = p;
+	}
+	p = &fv->vec[fv->cnt++];
+	memset(p, 0, sizeof(struct frame));
+	return p;
+}
+
+static void bench_deliver(struct rstate *rsp)
+{
+	struct frame *fp;
+
+	fp = fvec_add(&decoded);
+	fp->len = rsp->data_len / 8;
+	memcpy(fp->b, rsp->packet, fp->len);
+	fp->ts = rsp->pre_n;
+}
+
+static int frame_cmp(const struct frame *fa, const struct frame *fb)
+{
+
+	if (fa->len != fb->len)
+		return (fa->len < fb->len) ? -1 : 1;
+	return memcmp(fa->b, fb->b, fa->len);
+}
+
+// By the payload, then by the time, so repeats of a payload are in order.
+static int frame_sort_cmp(const void *a, const void *b)
+{
+	const struct frame *fa = a, *fb = b;
+	int c;
+
+	c = frame_cmp(fa, fb);
+	if (c != 0)
+		return c;
+	if (fa->ts != fb->ts)
+		return (fa->ts < fb->ts) ? -1 : 1;
+	return 0;
+}
+
+static void read_truth(const char *name)
+{
+	FILE *fp;
+	char line[100], *s;
+	unsigned int v;
+	struct frame *f;
+	unsigned long ts;
+
+	fp = fopen(name, "r");
+	if (fp == NULL) {
+		fprintf(stderr, TAG ": Cannot open %s: %s\n",
+		    name, strerror(errno));
+		exit(1);
+	}
+	while (fgets(line, 100, fp) != NULL) {
+		s = strchr(line, ' ');
+		if (s == NULL)
+			continue;
+		s++;
+		ts = strtoul(line, NULL, 10);
+		f = fvec_add(&emitted);
+		f->ts = ts;
+		while (f->len < 112/8 && sscanf(s, "%2x", &v) == 1) {
+			f->b[f->len++] = v;
+			s += 2;
+		}
+		if (f->len != 7 && f->len != 14) {
+			fprintf(stderr, TAG ": Invalid frame: %s", line);
+			emitted.cnt--;
+		}
+	}
+	fclose(fp);
+}
+
+/*
+ * Both vectors are sorted, so matching is a merge. A payload may repeat,
+ * such as the squitters of an aircraft that sits still, so the runs of the
+ * same payload are merged by the time: a decoded frame pairs up with the
+ * emitted one that is within TS_TOL of it. A frame emitted twice needs to
+ * be decoded twice to count twice.
+ */
+static unsigned long match_frames(void)
+{
+	unsigned long i, j, n;
+	long d;
+	int c;
+
+	qsort(decoded.vec, decoded.cnt, sizeof(struct frame), frame_sort_cmp);
+	qsort(emitted.vec, emitted.cnt, sizeof(struct frame), frame_sort_cmp);
+
+	n = 0;
+	i = 0;
+	j = 0;
+	while (i < decoded.cnt && j < emitted.cnt) {
+		c = frame_cmp(&decoded.vec[i], &emitted.vec[j]);
+		if (c < 0) {
+			i++;
+			continue;
+		}
+		if (c > 0) {
+			j++;
+			continue;
+		}
+		d = (long) decoded.vec[i].ts - (long) emitted.vec[j].ts;
+		if (d < -TS_TOL) {
+			i++;
+			continue;
+		}
+		if (d > TS_TOL) {
+			j++;
+			continue;
+		}
+		if (n == 0 || d < ts_min)
+			ts_min = d;
+		if (n == 0 || d > ts_max)
+			ts_max = d;
+		ts_sum += d;
+		n++;
+		i++;
+		j++;
+	}
+	return n;
+}
+
+int main(int argc, char **argv) {
+	char *raw_name = NULL, *truth_name = NULL;
+	const struct dvar *var = dvar_find(NULL);
+	unsigned int blk = BLK;
+	struct timespec t0, t1;
+	struct stat st;
+	unsigned char *base, *sp;
+	unsigned long total, left, matched;
+	unsigned int n, touch = 0;
+	const char *cor = "scan";
+	int fix_bits = 1, soft_bits = SOFT_BITS_MAX;
+	long dup_us = DUP_US;
+	double secs;
+	char *arg;
+	int fd;
+
+	argv++;
+	while ((arg = *argv++) != NULL) {
+		if (strcmp(arg, "-b") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			blk = strtoul(arg, NULL, 10);
+			if (blk == 0)
+				Usage();
+		} else if (strcmp(arg, "-R") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			var = dvar_find(arg);
+			if (var == NULL)
+				Usage();
+		} else if (strcmp(arg, "-m") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			if (strcmp(arg, "scan") != 0 &&
+			    strcmp(arg, "mask") != 0 &&
+			    strcmp(arg, "ring") != 0)
+				Usage();
+			cor = arg;
+		} else if (strcmp(arg, "-F") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			fix_bits = strtol(arg, NULL, 10);
+			if (fix_bits < 0 || fix_bits > CRC_FIX_MAX)
+				Usage();
+		} else if (strcmp(arg, "-K") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			soft_bits = strtol(arg, NULL, 10);
+			if (soft_bits < 0 || soft_bits > SOFT_BITS_MAX)
+				Usage();
+		} else if (strcmp(arg, "-D") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			dup_us = strtol(arg, NULL, 10);
+			if (dup_us < 0 || dup_us > 1000000)
+				Usage();
+		} else if (arg[0] == '-') {
+			Usage();
+		} else if (raw_name == NULL) {
+			raw_name = arg;
+		} else if (truth_name == NULL) {
+			truth_name = arg;
+		} else {
+			Usage();
+		}
+	}
+	if (raw_name == NULL)
+		Usage();
+
+	if (rstate_init(&rs, var, bench_deliver) != 0) {
+		fprintf(stderr, TAG ": No core\n");
+		exit(1);
+	}
+	rs.fix_bits = fix_bits;
+	rs.soft_bits = soft_bits;
+	rs.dup_win = (uint64_t) dup_us * var->srate / 1000000;
+	icao_init(&icao, (uint64_t) ICAO_TTL * var->srate);
+	rs.icao_p = &icao;
+	if (strcmp(cor, "mask") == 0)
+		rs.pre_match = var->pre_mask;
+	else if (strcmp(cor, "ring") == 0)
+		rs.pre_match = var->pre_ring;
+
+	fd = open(raw_name, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) != 0) {
+		fprintf(stderr, TAG ": Cannot open %s: %s\n",
+		    raw_name, strerror(errno));
+		exit(1);
+	}
+	if (st.st_size < 2) {
+		fprintf(stderr, TAG ": File %s is empty\n", raw_name);
+		exit(1);
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, TAG ": Cannot map %s: %s\n",
+		    raw_name, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+
+	// Fault the file in, so that we measure the decoder and not the disk.
+	for (sp = base; sp < base + st.st_size; sp += 4096)
+		touch += *(volatile unsigned char *)sp;
+
+	total = st.st_size / 2;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	sp = base;
+	for (left = total; left != 0; left -= n) {
+		n = (left < blk) ? left : blk;
+		dec_bias(&rs, sp, n);
+		dec_block(&rs, sp, n);
+		sp += n * 2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("samples %lu secs %.3f Ms/s %.2f\n",
+	    total, secs, total / secs / 1e6);
+	printf("decoded %lu frames/s %.0f errors %lu preambles %lu"
+	    " bad %lu fixed %lu soft %lu unknown %lu"
+	    " dups %lu\n",
+	    decoded.cnt, decoded.cnt / secs, rs.st.errors, rs.st.pre_hits,
+	    rs.st.crc_bad, rs.st.crc_fixed, rs.st.crc_soft,
+	    rs.st.ap_unknown, rs.st.dups);
+
+	if (truth_name != NULL) {
+		read_truth(truth_name);
+		matched = match_frames();
+		printf("emitted %lu matched %lu ratio %.4f false %lu\n",
+		    emitted.cnt, matched,
+		    emitted.cnt ? (double) matched / emitted.cnt : 0.0,
+		    decoded.cnt - matched);
+		if (matched != 0) {
+			printf("timestamp error min %ld max %ld avg %.2f\n",
+			    ts_min, ts_max, (double) ts_sum / matched);
+		}
+	}
+
+	munmap(base, st.st_size);
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Micro-benchmark of the signal processing pieces
+ *
+ * Runs every front end that this CPU can run over the same raw samples,
+ * checks that they agree with the scalar one, and reports the speed.
+ * Then does the same for the smoothers, against upd_ate().
+ * Without a file, a few seconds of noise are made up.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fe.h"
+#include "upd.h"
+
+#define TAG "bench_dsp"
+
+#define CHUNK  16384
+#define NSYN   (64*1024*1024)
+
+static void Usage(void) {
+	fprintf(stderr, "Usage: bench_dsp [file.raw]\n");
+	exit(1);
+}
+
+static double now_secs(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static unsigned char *load_raw(const char *name, unsigned long *np)
+{
+	struct stat st;
+	unsigned char *base;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) != 0) {
+		fprintf(stderr, TAG ": Cannot open %s: %s\n",
+		    name, strerror(errno));
+		exit(1);
+	}
+	if (st.st_size < 2) {
+		fprintf(stderr, TAG ": File %s is empty\n", name);
+		exit(1);
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE|MAP_POPULATE,
+	    fd, 0);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, TAG ": Cannot map %s: %s\n",
+		    name, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+	*np = st.st_size / 2;
+	return base;
+}
+
+static unsigned char *make_raw(unsigned long n)
+{
+	unsigned char *base;
+	unsigned int x = 1, v;
+	unsigned long i;
+
+	base = malloc(n * 2);
+	if (base == NULL) {
+		fprintf(stderr, TAG ": No core\n");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		x = x * 1103515245 + 12345;
+		v = 0x800 + ((x >> 16) & 0xFF) - 0x80;
+		base[i*2] = v & 0xFF;
+		base[i*2+1] = v >> 8;
+	}
+	return base;
+}
+
+/*
+ * The output goes into one chunk, like the decoder does, so we measure
+ * the front end and not the memory bandwidth for the output.
+ */
+static double run_fe(fe_mag_fn *mag, const unsigned char *raw,
+    unsigned long n, int16_t *out, int16_t *ref)
+{
+	static int16_t chunk[CHUNK];
+	unsigned long i, m;
+	double t0;
+
+	t0 = now_secs();
+	for (i = 0; i < n; i += m) {
+		m = (n - i < CHUNK) ? n - i : CHUNK;
+		(*mag)(raw + i*2, chunk, m, 0x800);
+		if (out != NULL)
+			memcpy(out + i, chunk, m * sizeof(int16_t));
+		else if (ref != NULL &&
+		    memcmp(ref + i, chunk, m * sizeof(int16_t)) != 0)
+			return -1.0;
+	}
+	return now_secs() - t0;
+}
+
+enum upd_kind { UPD_ATE, UPD_BLOCK, UPD_BLOCK_7 };
+
+/*
+ * Smooth the input with a fresh upd of the given length. With out, fill
+ * it; with ref, compare against it and return -1 on a mismatch.
+ */
+static double run_upd(enum upd_kind kind, int len, const int16_t *in,
+    unsigned long n, int16_t *out, int16_t *ref)
+{
+	static int16_t chunk[CHUNK];
+	struct upd u;
+	unsigned long i, m, j;
+	double t0, secs;
+
+	if (upd_init(&u, len) != 0) {
+		fprintf(stderr, TAG ": No core\n");
+		exit(1);
+	}
+	t0 = now_secs();
+	for (i = 0; i < n; i += m) {
+		m = (n - i < CHUNK) ? n - i : CHUNK;
+		switch (kind) {
+		case UPD_ATE:
+			for (j = 0; j < m; j++)
+				chunk[j] = upd_ate(&u, in[i + j]);
+			break;
+		case UPD_BLOCK:
+			upd_block(&u, in + i, chunk, m);
+			break;
+		default:
+			upd_block_7(&u, in + i, chunk, m);
+		}
+		if (out != NULL)
+			memcpy(out + i, chunk, m * sizeof(int16_t));
+		else if (ref != NULL &&
+		    memcmp(ref + i, chunk, m * sizeof(int16_t)) != 0)
+			return -1.0;
+	}
+	secs = now_secs() - t0;
+	upd_fini(&u);
+	return secs;
+}
+
+static void bench_upd(const char *title, enum upd_kind kind, int len,
+    const int16_t *in, unsigned long n, int16_t *ref)
+{
+	double secs;
+
+	if (run_upd(kind, len, in, n, NULL, ref) < 0) {
+		printf("upd %-18s MISMATCH\n", title);
+		return;
+	}
+	secs = run_upd(kind, len, in, n, NULL, NULL);
+	printf("upd %-18s %8.1f Ms/s\n", title, n / secs / 1e6);
+}
+
+int main(int argc, char **argv) {
+	const struct fe_impl *fp;
+	unsigned char *raw;
+	unsigned long n;
+	int16_t *ref, *mag, *sig;
+	unsigned long i;
+	double secs;
+
+	if (argc == 1) {
+		n = NSYN;
+		raw = make_raw(n);
+	} else if (argc == 2 && argv[1][0] != '-') {
+		raw = load_raw(argv[1], &n);
+	} else {
+		Usage();
+	}
+
+	ref = malloc(n * sizeof(int16_t));
+	if (ref == NULL) {
+		fprintf(stderr, TAG ": No core\n");
+		exit(1);
+	}
+	run_fe(fe_impl_vec[0].mag, raw, n, ref, NULL);
+
+	fe_init();
+	printf("samples %lu, front end picked: %s\n", n, fe_name);
+	for (fp = fe_impl_vec; fp->name != NULL; fp++) {
+		if (!(*fp->usable)()) {
+			printf("fe %-8s not supported\n", fp->name);
+			continue;
+		}
+		if (run_fe(fp->mag, raw, n, NULL, ref) < 0) {
+			printf("fe %-8s MISMATCH\n", fp->name);
+			continue;
+		}
+		secs = run_fe(fp->mag, raw, n, NULL, NULL);
+		printf("fe %-8s %8.1f Ms/s\n", fp->name, n / secs / 1e6);
+	}
+
+	/*
+	 * The decoder smooths magnitudes with the length of 7. The FM
+	 * receiver smooths signed samples over hundreds, so try that too.
+	 */
+	mag = ref;
+	ref = malloc(n * sizeof(int16_t));
+	sig = malloc(n * sizeof(int16_t));
+	if (ref == NULL || sig == NULL) {
+		fprintf(stderr, TAG ": No core\n");
+		exit(1);
+	}
+	run_upd(UPD_ATE, 7, mag, n, ref, NULL);
+	bench_upd("ate, len 7", UPD_ATE, 7, mag, n, ref);
+	bench_upd("block, len 7", UPD_BLOCK, 7, mag, n, ref);
+	bench_upd("block_7", UPD_BLOCK_7, 7, mag, n, ref);
+
+	for (i = 0; i < n; i++)
+		sig[i] = (int) (raw[i*2+1]<<8 | raw[i*2]) - 0x800;
+	run_upd(UPD_ATE, 997, sig, n, ref, NULL);
+	bench_upd("ate, len 997", UPD_ATE, 997, sig, n, ref);
+	bench_upd("block, len 997", UPD_BLOCK, 997, sig, n, ref);
+	return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * The block queue: raw transfers from the USB callback to the decoder
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "bq.h"
+#include "ring.h"
+
+static uint64_t now_ns(clockid_t clk)
+{
+	struct timespec t;
+
+	clock_gettime(clk, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/*
+ * The pre is the room for the prefix, in samples.
+ */
+int bq_init(struct bq *q, unsigned int nbuf, unsigned int pre)
+{
+	void *p;
+	unsigned int i;
+
+	memset(q, 0, sizeof(struct bq));
+	if (nbuf == 0 || (nbuf & (nbuf - 1)) != 0 || nbuf > BQ_NMAX) {
+		fprintf(stderr, "bq: the count of %u is not a power of 2\n",
+		    nbuf);
+		return -1;
+	}
+	q->nbuf = nbuf;
+	q->bufsz = (BQ_BUFSZ + pre * 2 + 4095) & ~4095;
+	ring_init(&q->ring, nbuf);
+	atomic_init(&q->closing, 0);
+	atomic_init(&q->blocks, 0);
+	atomic_init(&q->drops, 0);
+	atomic_init(&q->hw, 0);
+
+	q->efd = eventfd(0, 0);
+	if (q->efd == -1) {
+		fprintf(stderr, "bq: eventfd() failed: %s\n",
+		    strerror(errno));
+		goto err_efd;
+	}
+	q->vec = calloc(nbuf, sizeof(struct bq_blk));
+	if (q->vec == NULL)
+		goto err_vec;
+	if (posix_memalign(&p, 4096, nbuf * q->bufsz) != 0)
+		goto err_pool;
+	q->pool = p;
+	// Touch the pool now, so the callback does not take page faults.
+	memset(q->pool, 0, nbuf * q->bufsz);
+	for (i = 0; i < nbuf; i++)
+		q->vec[i].buf = q->pool + i * q->bufsz;
+	return 0;
+
+err_pool:
+	free(q->vec);
+err_vec:
+	fprintf(stderr, "bq: no core for %u buffers\n", nbuf);
+	close(q->efd);
+err_efd:
+	return -1;
+}
+
+static void bq_inc(atomic_ulong *p)
+{
+
+	atomic_store_explicit(p, atomic_load_explicit(p, memory_order_relaxed)
+	    + 1, memory_order_relaxed);
+}
+
+/*
+ * Wait until need buffers are free, or return -1 to drop.
+ */
+static int bq_room(struct bq *q, unsigned int need)
+{
+	struct timespec ts;
+
+	for (;;) {
+		if (q->nbuf - ring_count(&q->ring) >= need)
+			return 0;
+		if (!q->wait || need > q->nbuf) {
+			bq_inc(&q->drops);
+			return -1;
+		}
+		ts.tv_sec = 0;
+		ts.tv_nsec = 100000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+/*
+ * Fill the next buffer with the samples of a, then of b. There must be room.
+ */
+static void bq_fill(struct bq *q, const struct bq_blk *hdr,
+    const unsigned char *a, unsigned int na,
+    const unsigned char *b, unsigned int nb)
+{
+	struct bq_blk *bp;
+	unsigned char *buf;
+	int x;
+
+	x = ring_put_begin(&q->ring);
+	bp = &q->vec[x];
+	buf = bp->buf;
+	*bp = *hdr;
+	bp->buf = buf;
+	if (na != 0)
+		memcpy(buf, a, na * 2);
+	memcpy(buf + na * 2, b, nb * 2);
+	ring_put_end(&q->ring);
+	bq_inc(&q->blocks);
+}
+
+static void bq_kick(struct bq *q)
+{
+	unsigned int depth;
+
+	depth = ring_count(&q->ring);
+	if (depth > atomic_load_explicit(&q->hw, memory_order_relaxed))
+		atomic_store_explicit(&q->hw, depth, memory_order_relaxed);
+	eventfd_write(q->efd, 1);
+}
+
+/*
+ * Only call this from one thread, the USB callback or the replay.
+ * A transfer is either queued in full or dropped in full.
+ */
+void bq_put(struct bq *q, const void *data, unsigned int n)
+{
+	const unsigned char *sp = data;
+	struct bq_blk hdr;
+	unsigned int m;
+
+	if (bq_room(q, (n + BQ_BUFSZ/2 - 1) / (BQ_BUFSZ/2)) != 0) {
+		q->n += n;
+		q->skip += n;
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(struct bq_blk));
+	hdr.rt = now_ns(CLOCK_REALTIME);
+	hdr.mono = now_ns(CLOCK_MONOTONIC);
+	hdr.at_n = q->n + n;
+	while (n != 0) {
+		m = (n < BQ_BUFSZ/2) ? n : BQ_BUFSZ/2;
+		hdr.len = m;
+		hdr.n0 = q->n;
+		hdr.skip = q->skip;
+		bq_fill(q, &hdr, NULL, 0, sp, m);
+		q->skip = 0;
+		sp += m * 2;
+		q->n += m;
+		n -= m;
+	}
+	bq_kick(q);
+}
+
+/*
+ * Queue one block, made of the samples of a and then of b, which must fit
+ * into a buffer with its prefix. The caller fills the rest of the header,
+ * and keeps track of the sample index. Returns -1 if the block was
+ * dropped.
+ */
+int bq_put_blk(struct bq *q, const struct bq_blk *hdr,
+    const unsigned char *a, unsigned int na,
+    const unsigned char *b, unsigned int nb)
+{
+
+	if (bq_room(q, 1) != 0)
+		return -1;
+	bq_fill(q, hdr, a, na, b, nb);
+	bq_kick(q);
+	return 0;
+}
+
+/*
+ * The producer is done, the consumer gets NULL once the queue is empty.
+ */
+void bq_close(struct bq *q)
+{
+
+	atomic_store_explicit(&q->closing, 1, memory_order_release);
+	eventfd_write(q->efd, 1);
+}
+
+/*
+ * Only call this from one thread, the decoder. Blocks until there's
+ * something in the queue. The block stays ours until bq_done().
+ */
+struct bq_blk *bq_get(struct bq *q)
+{
+	eventfd_t v;
+	int x;
+
+	for (;;) {
+		x = ring_get_begin(&q->ring);
+		if (x != -1)
+			return &q->vec[x];
+		if (atomic_load_explicit(&q->closing, memory_order_acquire)) {
+			// A block may have come in just before the close.
+			x = ring_get_begin(&q->ring);
+			return (x == -1) ? NULL : &q->vec[x];
+		}
+		eventfd_read(q->efd, &v);
+	}
+}
+
+void bq_done(struct bq *q)
+{
+
+	ring_get_end(&q->ring);
+}
+
+/*
+ * Any thread. The counts are since the start.
+ */
+void bq_stats(struct bq *q, struct bq_stats *sp)
+{
+
+	sp->blocks = atomic_load_explicit(&q->blocks, memory_order_relaxed);
+	sp->drops = atomic_load_explicit(&q->drops, memory_order_relaxed);
+	sp->hw = atomic_load_explicit(&q->hw, memory_order_relaxed);
+	sp->size = q->nbuf;
+}
+
+void bq_fini(struct bq *q)
+{
+
+	close(q->efd);
+	free(q->pool);
+	free(q->vec);
+}
@@ -0,0 +1,68 @@
+/*
+ * The block queue: raw transfers from the USB callback to the decoder
+ *
+ * The callback only copies a transfer into preallocated buffers and
+ * pushes them onto a ring, so that a hiccup of the decoder does not stall
+ * the USB. A transfer that does not fit in the free buffers is dropped in
+ * full, and the decoder sees a gap in the sample index.
+ *
+ * For the parallel decoding, there's a queue per worker, and the blocks
+ * carry a prefix of the samples before them, see rx_fan() in main.c.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "ring.h"
+
+// The buffers are page-aligned, the count must be a power of 2.
+// A buffer may have room for a prefix on top of BQ_BUFSZ.
+#define BQ_BUFSZ  (256*1024)
+#define BQ_NBUF   32
+#define BQ_NMAX   1024
+
+struct bq_blk {
+	unsigned char *buf;
+	unsigned int pre;	// samples in front of n0
+	unsigned int len;	// in samples, after the prefix
+	uint64_t n0;		// the index of the first sample after it
+	unsigned long skip;	// samples dropped just before this block
+	unsigned int bias;	// the DC bias, if the producer keeps it
+	// The time when the transfer arrived, and the index of its end.
+	uint64_t at_n;
+	uint64_t rt, mono;	// in ns
+};
+
+struct bq_stats {
+	unsigned long blocks;
+	unsigned long drops;	// in transfers
+	unsigned int hw;	// the most blocks that were ever queued
+	unsigned int size;
+};
+
+struct bq {
+	struct ring ring;
+	struct bq_blk *vec;
+	unsigned char *pool;
+	unsigned int nbuf;
+	size_t bufsz;		// in bytes, with the room for the prefix
+	int efd;		// kicked once per transfer
+	int wait;		// wait for room instead of dropping
+	atomic_int closing;
+	uint64_t n;		// the producer: samples seen
+	unsigned long skip;	// the producer: samples dropped since a put
+	// Only the producer writes these.
+	atomic_ulong blocks, drops;
+	atomic_uint hw;
+};
+
+int bq_init(struct bq *q, unsigned int nbuf, unsigned int pre);
+void bq_put(struct bq *q, const void *data, unsigned int n);
+int bq_put_blk(struct bq *q, const struct bq_blk *hdr,
+    const unsigned char *a, unsigned int na,
+    const unsigned char *b, unsigned int nb);
+void bq_close(struct bq *q);
+struct bq_blk *bq_get(struct bq *q);
+void bq_done(struct bq *q);
+void bq_stats(struct bq *q, struct bq_stats *sp);
+void bq_fini(struct bq *q);
@@ -0,0 +1,187 @@
+/*
+ * The Mode S parity: CRC-24 with the polynomial 0x1FFF409
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc.h"
+
+#define CRC_POLY  0xFFF409	// without the x^24
+
+/*
+ * The CRC is kept in the top 24 bits of a 32-bit word, so that a whole
+ * 32-bit word of the message can be XOR-ed into it at once. The table k
+ * is for a byte followed by k zero bytes.
+ */
+static uint32_t crc_tab[8][256];
+
+/*
+ * The syndromes of all 1-bit and 2-bit errors in a 112-bit frame, with
+ * open addressing. We never flip the first 5 bits, which are the DF:
+ * a wrong DF would not be checked as DF17 in the first place.
+ */
+#define FIX_SIZE  16384		// a power of 2, over twice the C(107,2)+107
+#define FIX_FIRST 5
+
+struct crc_fix1 {
+	uint32_t syn;		// zero if the slot is free
+	unsigned char nbits;	// zero if two patterns collide
+	unsigned char bit[2];
+};
+
+static struct crc_fix1 fix_tab[FIX_SIZE];
+static int crc_ready;
+
+// The syndromes of every 1-bit error in the short and long frames.
+static uint32_t syn_56[56];
+static uint32_t syn_112[112];
+
+static unsigned int fix_hash(uint32_t syn)
+{
+	return (syn * 0x9E3779B1U) >> (32 - 14);
+}
+
+static void fix_add(uint32_t syn, int nbits, int b0, int b1)
+{
+	struct crc_fix1 *fp;
+	unsigned int x;
+
+	x = fix_hash(syn);
+	for (;;) {
+		fp = &fix_tab[x];
+		if (fp->syn == 0) {
+			fp->syn = syn;
+			fp->nbits = nbits;
+			fp->bit[0] = b0;
+			fp->bit[1] = b1;
+			return;
+		}
+		if (fp->syn == syn) {
+			fp->nbits = 0;
+			return;
+		}
+		x = (x + 1) & (FIX_SIZE - 1);
+	}
+}
+
+void crc_init(void)
+{
+	unsigned char pkt[14];
+	uint32_t c;
+	int i, j, k;
+
+	if (crc_ready)
+		return;
+
+	for (i = 0; i < 256; i++) {
+		c = (uint32_t) i << 24;
+		for (j = 0; j < 8; j++) {
+			if (c & 0x80000000)
+				c = (c << 1) ^ ((uint32_t) CRC_POLY << 8);
+			else
+				c <<= 1;
+		}
+		crc_tab[0][i] = c;
+	}
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			c = crc_tab[k-1][i];
+			crc_tab[k][i] = (c << 8) ^ crc_tab[0][c >> 24];
+		}
+	}
+
+	for (i = 0; i < 112; i++) {
+		memset(pkt, 0, 14);
+		pkt[i >> 3] = 0x80 >> (i & 7);
+		syn_112[i] = crc_syndrome(pkt, 14);
+		if (i < 56)
+			syn_56[i] = crc_syndrome(pkt, 7);
+	}
+
+	// The syndromes are linear, so a 2-bit one is a XOR of two 1-bit.
+	for (i = FIX_FIRST; i < 112; i++) {
+		fix_add(syn_112[i], 1, i, i);
+		for (j = i + 1; j < 112; j++)
+			fix_add(syn_112[i] ^ syn_112[j], 2, i, j);
+	}
+
+	crc_ready = 1;
+}
+
+/*
+ * The remainder of the message times x^24, in the low 24 bits.
+ */
+uint32_t crc_bytes(const unsigned char *p, unsigned int n)
+{
+	uint32_t crc = 0, w0, w1;
+
+	while (n >= 8) {
+		w0 = crc ^ ((uint32_t) p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3]);
+		w1 = (uint32_t) p[4]<<24 | p[5]<<16 | p[6]<<8 | p[7];
+		crc = crc_tab[7][w0 >> 24] ^ crc_tab[6][(w0 >> 16) & 0xFF] ^
+		    crc_tab[5][(w0 >> 8) & 0xFF] ^ crc_tab[4][w0 & 0xFF] ^
+		    crc_tab[3][w1 >> 24] ^ crc_tab[2][(w1 >> 16) & 0xFF] ^
+		    crc_tab[1][(w1 >> 8) & 0xFF] ^ crc_tab[0][w1 & 0xFF];
+		p += 8;
+		n -= 8;
+	}
+	if (n >= 4) {
+		w0 = crc ^ ((uint32_t) p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3]);
+		crc = crc_tab[3][w0 >> 24] ^ crc_tab[2][(w0 >> 16) & 0xFF] ^
+		    crc_tab[1][(w0 >> 8) & 0xFF] ^ crc_tab[0][w0 & 0xFF];
+		p += 4;
+		n -= 4;
+	}
+	while (n != 0) {
+		crc = (crc << 8) ^ crc_tab[0][(crc >> 24) ^ *p++];
+		n--;
+	}
+	return crc >> 8;
+}
+
+/*
+ * The frame is len bytes, 7 or 14, with the parity in the last 3.
+ */
+uint32_t crc_syndrome(const unsigned char *pkt, unsigned int len)
+{
+	const unsigned char *pp = pkt + len - 3;
+
+	return crc_bytes(pkt, len - 3) ^ (pp[0]<<16 | pp[1]<<8 | pp[2]);
+}
+
+/*
+ * The syndrome of a flip of the given bit in a frame of len bytes.
+ */
+uint32_t crc_bit(unsigned int len, int bit)
+{
+	return (len == 14) ? syn_112[bit] : syn_56[bit];
+}
+
+/*
+ * Fix up to maxbits bits of a 112-bit frame with the syndrome syn.
+ * Returns the number of bits flipped, or -1 if the frame is beyond help.
+ */
+int crc_fix(unsigned char *pkt, uint32_t syn, int maxbits)
+{
+	struct crc_fix1 *fp;
+	unsigned int x;
+	int i;
+
+	if (syn == 0)
+		return 0;
+	x = fix_hash(syn);
+	for (;;) {
+		fp = &fix_tab[x];
+		if (fp->syn == 0)
+			return -1;
+		if (fp->syn == syn)
+			break;
+		x = (x + 1) & (FIX_SIZE - 1);
+	}
+	if (fp->nbits == 0 || fp->nbits > maxbits)
+		return -1;
+	for (i = 0; i < fp->nbits; i++)
+		pkt[fp->bit[i] >> 3] ^= 0x80 >> (fp->bit[i] & 7);
+	return fp->nbits;
+}
@@ -0,0 +1,19 @@
+/*
+ * The Mode S parity: CRC-24 with the polynomial 0x1FFF409
+ *
+ * The CRC runs 8 bytes at a time with slicing tables. The syndrome of
+ * a frame is the CRC of its data XOR its parity field, zero if the frame
+ * is good, and the same for the same error pattern in any frame of the
+ * same length. So a table of syndromes finds the bits to flip.
+ */
+
+#include <stdint.h>
+
+// Up to this many bits are flipped to fix a long frame.
+#define CRC_FIX_MAX  2
+
+void crc_init(void);
+uint32_t crc_bytes(const unsigned char *p, unsigned int n);
+uint32_t crc_syndrome(const unsigned char *pkt, unsigned int len);
+uint32_t crc_bit(unsigned int len, int bit);
+int crc_fix(unsigned char *pkt, uint32_t syn, int maxbits);
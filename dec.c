@@ -0,0 +1,634 @@
+/*
+ * airspy_yoga
+ * The decoder: from raw samples to packets
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc.h"
+#include "fe.h"
+#include "icao.h"
+#include "upd.h"
+#include "yoga.h"
+
+/*
+ * We're treating the offset by 0x800 as a part of the DC bias.
+ */
+#define BVLEN  (128)
+
+// Method Zero: direct calculation of the average
+#if 1
+static unsigned int dc_bias_update(const unsigned char *sp)
+{
+	int i;
+	unsigned int sum;
+
+	sum = 0;
+	for (i = 0; i < BVLEN; i++) {
+		sum += ((unsigned int) sp[1])<<8 | sp[0];
+		sp += 2;
+	}
+	return sum / BVLEN;
+}
+#endif
+
+int rstate_init(struct rstate *rsp, const struct dvar *var,
+    void (*deliver)(struct rstate *rsp))
+{
+
+	memset(rsp, 0, sizeof(struct rstate));
+	rsp->var = var;
+	rsp->pre_match = NULL;
+	if (upd_init(&rsp->smoo, var->avglen) != 0)
+		return -1;
+	rsp->dc_bias = 0x800;
+	rsp->fix_bits = 1;
+	rsp->soft_bits = SOFT_BITS_MAX;
+	rsp->icao_p = NULL;
+	rsp->own_lo = 0;
+	rsp->own_hi = UINT64_MAX;
+	rsp->dup_win = (uint64_t) DUP_US * var->srate / 1000000;
+	rsp->deliver = deliver;
+	fe_init();
+	crc_init();
+	return 0;
+}
+
+/*
+ * Refresh the DC bias every 10th transfer. Call this once per transfer.
+ */
+void dec_bias(struct rstate *rsp, const unsigned char *sp, unsigned int n)
+{
+
+	bias_update(&rsp->dc_bias, &rsp->bias_timer, sp, n);
+}
+
+/*
+ * The same, for those who split the stream before the decoders.
+ */
+void bias_update(unsigned int *biasp, unsigned int *timerp,
+    const unsigned char *sp, unsigned int n)
+{
+#if 1 /* Method Zero */
+	if (*timerp == 0) {
+		if (n >= BVLEN)
+			*biasp = dc_bias_update(sp);
+	}
+	*timerp = (*timerp + 1) % 10;
+#endif
+}
+
+/*
+ * A preamble ends at the sample i of the current block.
+ */
+static inline __attribute__((always_inline))
+void dec_found(struct rstate *rsp, const int16_t *pv, int i,
+    const int spb, const int avglen)
+{
+	const int h = spb/2;
+
+	/*
+	 * The match comes at the end of the last half-bit of the preamble,
+	 * but the smoother lags by half its length. With the scan, i may be
+	 * negative: the best phase was in the previous block.
+	 */
+	rsp->pre_n = rsp->clock + i + 1 - APP*(spb/2) + avglen/2;
+	rsp->frame_at = rsp->clock + i;
+	rsp->st.pre_hits++;
+	rsp->state = DATA;
+	rsp->pre_level = (pv[i - 15*h] + pv[i - 13*h] +
+	    pv[i - 8*h] + pv[i - 6*h]) / 4;	// the pulses of pfun[]
+	rsp->erasures = 0;
+	rsp->bit_cnt = 0;
+	memset(rsp->packet, 0, 112/8);
+}
+
+/*
+ * Hunt with the full-rate correlator, from the sample i of the block.
+ * Once something matches, look for a better phase for a quarter of a
+ * bit, then go with the best. Returns where to continue.
+ */
+static inline __attribute__((always_inline))
+unsigned int dec_scan_t(struct rstate *rsp, const int16_t *pv,
+    unsigned int i, unsigned int n, const int spb, const int avglen)
+{
+	const int16_t *score = rsp->score;
+
+	for (; i < n; i++) {
+		if (rsp->hunt_skip != 0) {
+			rsp->hunt_skip--;
+		} else if (rsp->pre_look != 0) {
+			rsp->pre_age++;
+			if (score[i] > rsp->pre_best) {
+				rsp->pre_best = score[i];
+				rsp->pre_age = 0;
+			}
+			if (--rsp->pre_look == 0) {
+				dec_found(rsp, pv, (int) i - rsp->pre_age,
+				    spb, avglen);
+				return i + 1;
+			}
+		} else if (score[i] != PRE_NONE) {
+			rsp->pre_best = score[i];
+			rsp->pre_age = 0;
+			rsp->pre_look = spb/4;
+		}
+	}
+	return n;
+}
+
+/*
+ * Hunt with the tracks, probing every df samples.
+ */
+static inline __attribute__((always_inline))
+unsigned int dec_probe_t(struct rstate *rsp, const int16_t *pv,
+    unsigned int i, unsigned int n, const int spb, const int df,
+    const int avglen)
+{
+
+	for (; i < n; i++) {
+		if (++rsp->dec >= df) {
+			rsp->dec = 0;
+			if ((*rsp->pre_match)(rsp, pv[i])) {
+				dec_found(rsp, pv, i, spb, avglen);
+				return i + 1;
+			}
+		}
+	}
+	return n;
+}
+
+/*
+ * Slice len bits that follow the preamble ending at pv[b], starting
+ * with the bit j. Every bit is a pair of half-bits, h samples apart.
+ * The difference between them is the confidence of the bit.
+ *
+ * We're promiscuous with the manchester, by accepting any level change.
+ * Where there is no change, the bit is erased: it gets a zero and no
+ * confidence, for dec_soft() to sort out. Once there are more erasures
+ * than it may fix, we give up and return the index of the bit. If all
+ * goes well, return len.
+ */
+static inline __attribute__((always_inline))
+int dec_bits_t(struct rstate *rsp, const int16_t *pv, int b,
+    int j, int len, const int h)
+{
+	const int16_t *sp;
+	int p_half, p, d;
+
+	sp = pv + b + (2*j + 1)*h;
+	for (; j < len; j++) {
+		p_half = sp[0];
+		p = sp[h];
+		d = p_half - p;
+		if (p_half <= 0 || p <= 0 || d == 0) {
+			if (++rsp->erasures > rsp->soft_bits)
+				return j;
+			rsp->conf[j] = 0;
+		} else {
+			rsp->conf[j] = abs(d);
+		}
+		rsp->packet[j >> 3] |= (d > 0) << (7 - (j & 07));
+		sp += 2*h;
+	}
+	return len;
+}
+
+/*
+ * Try to fix a frame that failed the parity by flipping its weakest
+ * bits, and return the number of bits flipped, or -1. Only the bits with
+ * the confidence under a quarter of the preamble level are considered,
+ * up to soft_bits of them, and never the DF. All their combinations are
+ * tried, the fewest flips first, for the syndrome to clear under mask.
+ */
+#define SOFT_FIRST 5
+
+static int dec_soft(struct rstate *rsp, uint32_t syn, uint32_t mask)
+{
+	static const unsigned char order[7] = { 1, 2, 4, 3, 5, 6, 7 };
+	unsigned int len = rsp->data_len;
+	unsigned int thr = rsp->pre_level / 4;
+	int weak[SOFT_BITS_MAX];
+	int nweak, i, k, t, s;
+	uint32_t x;
+
+	if (rsp->soft_bits == 0)
+		return -1;
+	nweak = 0;
+	for (i = SOFT_FIRST; i < len; i++) {
+		if (rsp->conf[i] >= thr)
+			continue;
+		// Insert in the order of confidence, dropping the strongest.
+		if (nweak < rsp->soft_bits)
+			nweak++;
+		else if (rsp->conf[i] >= rsp->conf[weak[nweak-1]])
+			continue;
+		for (k = nweak - 1; k > 0 && rsp->conf[weak[k-1]] > rsp->conf[i];
+		    k--)
+			weak[k] = weak[k-1];
+		weak[k] = i;
+	}
+
+	for (k = 0; k < 7; k++) {
+		s = order[k];
+		if (s >= (1 << nweak))
+			continue;
+		x = syn;
+		for (t = 0; t < nweak; t++) {
+			if (s & (1 << t))
+				x ^= crc_bit(len / 8, weak[t]);
+		}
+		if ((x & mask) == 0) {
+			for (t = 0; t < nweak; t++) {
+				if (s & (1 << t))
+					rsp->packet[weak[t] >> 3] ^=
+					    0x80 >> (weak[t] & 7);
+			}
+			return __builtin_popcount(s);
+		}
+	}
+	return -1;
+}
+
+/*
+ * Return 1 if the same frame went out within win samples of t, before or
+ * after, because the merged sources are not quite in order. The cache of
+ * 1 << DUP_BITS slots is direct-mapped by a hash of the frame, so
+ * a collision only lets a duplicate through, and never drops a frame
+ * that is new.
+ *
+ * The window is meant for echoes, a few tens of microseconds. Replies to
+ * back-to-back interrogations and the squitters are real repeats, and are
+ * further apart. The merge of several sources looks wider, so it passes
+ * the source, and then only a frame heard by another source is a repeat.
+ */
+int dup_seen(struct dup1 *dupv, uint64_t win, const unsigned char *pkt,
+    unsigned int len, uint64_t t, int src)
+{
+	struct dup1 *dp;
+	uint64_t a, b;
+	unsigned int x;
+
+	if (win == 0)
+		return 0;
+	a = 0;
+	b = 0;
+	memcpy(&a, pkt, 7);
+	if (len == 14)
+		memcpy(&b, pkt + 7, 7);
+	x = ((a ^ b * 0x9E3779B97F4A7C15ULL) * 0xBF58476D1CE4E5B9ULL) >>
+	    (64 - DUP_BITS);
+	dp = &dupv[x];
+	if (dp->len == len && (t - dp->t < win || dp->t - t < win) &&
+	    (src == -1 || dp->src != src) &&
+	    memcmp(dp->packet, pkt, len) == 0)
+		return 1;
+	dp->len = len;
+	dp->t = t;
+	dp->src = src;
+	memcpy(dp->packet, pkt, len);
+	return 0;
+}
+
+/*
+ * Fill the address cache from a clean frame, or check the address of
+ * a reply against it. Return -1 for a reply from an unknown address,
+ * and 0 if the frame may go out.
+ *
+ * The cache must see the frames in the order of their time. A decoder
+ * that owns only a piece of the stream leaves this to whoever merges
+ * the pieces, see dec_deliver().
+ */
+int dec_addr(struct icao *ic, const unsigned char *pkt, unsigned int len,
+    int clean, uint64_t t)
+{
+
+	switch (pkt[0] >> 3) {
+	case 0:
+	case 4:
+	case 5:
+	case 16:
+	case 20:
+	case 21:
+		return icao_seen(ic, crc_syndrome(pkt, len), t) ? 0 : -1;
+	}
+	if (clean)
+		icao_add(ic, pkt[1] << 16 | pkt[2] << 8 | pkt[3], t);
+	return 0;
+}
+
+/*
+ * Check the parity of a sliced frame, and deliver it if it's good.
+ *
+ * The DF11 carries the interrogator code in the low 7 bits of parity.
+ * The DF17 and DF18 carry the plain CRC. If the check fails, we flip the
+ * weakest bits first, then for the long frames let the syndrome say
+ * which bits to flip. Only the DF11, DF17 and DF18 that passed the parity
+ * as they came fill the address cache: a wrong repair would vouch for
+ * a made-up address for the whole ICAO_TTL.
+ *
+ * The replies to interrogations overlay the parity with the address,
+ * so the syndrome is the address, and they go out if it's in the cache.
+ * We do not try to repair them: any address would do for a wrong bit.
+ * The rest of DFs go out unchecked, unless some of their bits were erased.
+ * Either way, a frame that just went out does not go out again.
+ *
+ * A frame outside of the owned window belongs to another decoder, which
+ * sees the same samples, so its parity and repeats are left to that one.
+ * Without the cache, the addresses and the repeats are left to the merge,
+ * and the frame goes out with rsp->clean for it to pass to dec_addr().
+ */
+static void dec_deliver(struct rstate *rsp)
+{
+	unsigned int df = rsp->packet[0] >> 3;
+	uint32_t syn, mask;
+	int clean = 0;
+
+	if (rsp->pre_n < rsp->own_lo || rsp->pre_n >= rsp->own_hi)
+		return;
+
+	switch (df) {
+	case 11:
+		mask = 0xFFFF80;
+		break;
+	case 17:
+	case 18:
+		mask = 0xFFFFFF;
+		break;
+	case 0:
+	case 4:
+	case 5:
+	case 16:
+	case 20:
+	case 21:
+		if (rsp->erasures != 0)
+			goto bad;
+		goto good;
+	default:
+		// Without the parity to check, a guessed bit is a wrong bit.
+		if (rsp->erasures != 0)
+			goto bad;
+		goto good;
+	}
+
+	syn = crc_syndrome(rsp->packet, rsp->data_len / 8);
+	if ((syn & mask) == 0) {
+		// An erased bit that came out right is still a guess.
+		clean = (rsp->erasures == 0);
+		goto good;
+	}
+	if (dec_soft(rsp, syn, mask) > 0) {
+		rsp->st.crc_soft++;
+		goto good;
+	}
+	if (mask == 0xFFFFFF && rsp->data_len == 112 &&
+	    crc_fix(rsp->packet, syn, rsp->fix_bits) > 0) {
+		rsp->st.crc_fixed++;
+		goto good;
+	}
+bad:
+	rsp->st.crc_bad++;
+	return;
+
+good:
+	rsp->clean = clean;
+	if (rsp->icao_p != NULL &&
+	    dec_addr(rsp->icao_p, rsp->packet, rsp->data_len / 8, clean,
+	    rsp->pre_n) != 0) {
+		rsp->st.ap_unknown++;
+		return;
+	}
+	if (dup_seen(rsp->dupv, rsp->dup_win, rsp->packet, rsp->data_len / 8,
+	    rsp->pre_n, -1)) {
+		rsp->st.dups++;
+		return;
+	}
+	(*rsp->deliver)(rsp);
+}
+
+/*
+ * Slice the frame after the preamble that ends at pv[b] straight from
+ * the block, as far as the block goes, and deliver it when done. If the
+ * block ends first, return -1, and the next block continues with the
+ * bits that it has, while this one remains in its history. Otherwise,
+ * return the index of the last sample that we looked at. It is always
+ * in this block, because a failure in the earlier bits ends the frame
+ * with the block that has them.
+ */
+static inline __attribute__((always_inline))
+int dec_slice_t(struct rstate *rsp, const int16_t *pv, int b, unsigned int n,
+    const int spb)
+{
+	const int h = spb/2;
+	int avail, m, j;
+
+	avail = ((int) n - 1 - b) / spb;	// whole bits in the block
+	j = rsp->bit_cnt;
+	if (j < 56) {
+		m = (avail < 56) ? avail : 56;
+		j = dec_bits_t(rsp, pv, b, j, m, h);
+		if (j < m)
+			goto err;
+		if (j < 56) {
+			rsp->bit_cnt = j;
+			return -1;
+		}
+		if ((rsp->packet[0] & 0x80) == 0) {
+			rsp->data_len = 56;
+			rsp->st.frames_56++;
+			dec_deliver(rsp);
+			return b + 56*spb;
+		}
+	}
+	m = (avail < 112) ? avail : 112;
+	j = dec_bits_t(rsp, pv, b, j, m, h);
+	if (j < m)
+		goto err;
+	if (j < 112) {
+		rsp->bit_cnt = j;
+		return -1;
+	}
+	rsp->data_len = 112;
+	rsp->st.frames_112++;
+	dec_deliver(rsp);
+	return b + 112*spb;
+
+err:
+	/*
+	 * Not sure if we should skip up to data_len bits here.
+	 * For simplicity, we just go to HUNT.
+	 */
+	rsp->st.errors++;
+	return b + (j + 1)*spb;
+}
+
+/*
+ * Run n magnitudes through the decoder.
+ *
+ * This is a template of sorts: every variant calls it with constants,
+ * and gets its own copy with the loop bounds and divisions folded.
+ * The correlator is picked at run time, see rstate.pre_match.
+ *
+ * The smoothed magnitudes go after the history in rsp->pv, and at the
+ * end the tail of this block becomes the history for the next one.
+ * Only the hunt walks the block sample by sample. Once it finds a
+ * preamble, the frame is sliced at once, and the hunt resumes after it.
+ */
+static inline __attribute__((always_inline))
+void dec_mag_t(struct rstate *rsp, const int16_t *mag, unsigned int n,
+    const int spb, const int df, const int avglen)
+{
+	int16_t *pv = rsp->pv + PVHIST;
+	unsigned int i;
+	int r;
+
+	upd_block_t(&rsp->smoo, mag, pv, n, avglen, 1);
+	if (rsp->pre_match == NULL)
+		(*rsp->var->pre_scan)(pv, rsp->score, n);
+
+	i = 0;
+	for (;;) {
+		if (rsp->state == DATA) {
+			r = dec_slice_t(rsp, pv, rsp->frame_at - rsp->clock,
+			    n, spb);
+			if (r < 0)
+				break;
+			rstate_hunt(rsp);
+			i = r + 1;
+		}
+		if (i >= n)
+			break;
+		if (rsp->pre_match == NULL)
+			i = dec_scan_t(rsp, pv, i, n, spb, avglen);
+		else
+			i = dec_probe_t(rsp, pv, i, n, spb, df, avglen);
+		if (rsp->state != DATA)
+			break;
+	}
+
+	memmove(rsp->pv, rsp->pv + n, PVHIST * sizeof(int16_t));
+	rsp->st.samples += n;
+	rsp->clock += n;
+}
+
+/*
+ * The variants. A half-bit must be a whole number of samples, and the
+ * correlator looks at every half-bit nt times, so nt*df == spb/2.
+ *
+ * The 20 Ms/s is the native rate of the AirSpy R2. The 12 Ms/s is for
+ * the AirSpy Mini. The 10 Ms/s halves the USB load, but a half-bit is
+ * only 5 samples, so it runs the correlator on every sample to make up.
+ * This still takes less CPU than the 20 Ms/s.
+ */
+static void dec_mag_20(struct rstate *rsp, const int16_t *mag, unsigned int n)
+{
+	dec_mag_t(rsp, mag, n, 20, 5, 7);
+}
+
+static void dec_mag_12(struct rstate *rsp, const int16_t *mag, unsigned int n)
+{
+	dec_mag_t(rsp, mag, n, 12, 3, 4);
+}
+
+static void dec_mag_10(struct rstate *rsp, const int16_t *mag, unsigned int n)
+{
+	dec_mag_t(rsp, mag, n, 10, 1, 4);
+}
+
+const struct dvar dvar_vec[] = {
+	{ "20", 20000000, 20, 5, 2, 7, dec_mag_20,
+	    preamble_mask_2, preamble_match_2, pre_scan_10 },
+	{ "12", 12000000, 12, 3, 2, 4, dec_mag_12,
+	    preamble_mask_2, preamble_match_2, pre_scan_6 },
+	{ "10", 10000000, 10, 1, 5, 4, dec_mag_10,
+	    preamble_mask_5, preamble_match_5, pre_scan_5 },
+	{ NULL }
+};
+
+/*
+ * Look up a variant by its rate in Ms/s, or the default with NULL.
+ */
+const struct dvar *dvar_find(const char *name)
+{
+	const struct dvar *vp;
+
+	if (name == NULL)
+		return &dvar_vec[0];
+	for (vp = dvar_vec; vp->name != NULL; vp++) {
+		if (strcmp(vp->name, name) == 0)
+			return vp;
+	}
+	return NULL;
+}
+
+/*
+ * Run n raw samples through the decoder. Packets are handed to
+ * rsp->deliver() as they are found.
+ *
+ * The front end converts MAGLEN samples at a time, which keeps
+ * the magnitudes in the cache while the decoder walks them.
+ */
+void dec_block(struct rstate *rsp, const unsigned char *sp, unsigned int n)
+{
+	unsigned int m;
+
+	while (n != 0) {
+		m = (n < MAGLEN) ? n : MAGLEN;
+		(*fe_mag)(sp, rsp->mag, m, rsp->dc_bias);
+		(*rsp->var->dec_mag)(rsp, rsp->mag, m);
+		sp += m * 2;
+		n -= m;
+	}
+}
+
+/*
+ * The writer is the decoding thread. It never waits for readers.
+ */
+void stats_publish(struct dstats_pub *pub, const struct dstats *st)
+{
+	const unsigned long *v = (const unsigned long *) st;
+	unsigned int seq;
+	int i;
+
+	seq = atomic_load_explicit(&pub->seq, memory_order_relaxed);
+	atomic_store_explicit(&pub->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (i = 0; i < DSTATS_N; i++)
+		atomic_store_explicit(&pub->v[i], v[i], memory_order_relaxed);
+	atomic_store_explicit(&pub->seq, seq + 2, memory_order_release);
+}
+
+/*
+ * The readers retry if the writer was in the middle of an update.
+ */
+void stats_fetch(struct dstats_pub *pub, struct dstats *st)
+{
+	unsigned long *v = (unsigned long *) st;
+	unsigned int seq0, seq1;
+	int i;
+
+	do {
+		seq0 = atomic_load_explicit(&pub->seq, memory_order_acquire);
+		for (i = 0; i < DSTATS_N; i++)
+			v[i] = atomic_load_explicit(&pub->v[i],
+			    memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		seq1 = atomic_load_explicit(&pub->seq, memory_order_relaxed);
+	} while ((seq0 & 1) != 0 || seq0 != seq1);
+}
+
+/*
+ * Let's avoid triggering an erroneous match with stale samples.
+ */
+void rstate_hunt(struct rstate *rsp)
+{
+
+	rsp->tx = 0;
+	memset(rsp->tvec, 0, sizeof(struct track)*NTMAX);
+	rsp->dec = 0;
+	rsp->pre_look = 0;
+	rsp->hunt_skip = (APP-1) * (rsp->var->spb/2);
+
+	rsp->state = HUNT;
+}
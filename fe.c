@@ -0,0 +1,115 @@
+/*
+ * The front end: raw samples to magnitudes, a whole transfer at a time
+ */
+
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FE_X86 1
+#else
+#define FE_X86 0
+#endif
+
+#include "fe.h"
+
+fe_mag_fn *fe_mag;
+const char *fe_name;
+
+static void fe_mag_scalar(const unsigned char *sp, int16_t *out,
+    unsigned int n, unsigned int bias)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		out[i] = abs((int) (sp[1]<<8 | sp[0]) - (int) bias);
+		sp += 2;
+	}
+}
+
+static int fe_usable_always(void)
+{
+	return 1;
+}
+
+#if FE_X86
+/*
+ * The x86 is little-endian, so the raw samples load straight into lanes.
+ * The SSE2 has no abs for 16-bit lanes, so we take max(x, -x).
+ */
+__attribute__((target("sse2")))
+static void fe_mag_sse2(const unsigned char *sp, int16_t *out,
+    unsigned int n, unsigned int bias)
+{
+	__m128i vb, v, zero;
+	unsigned int i;
+
+	vb = _mm_set1_epi16(bias);
+	zero = _mm_setzero_si128();
+	for (i = 0; i + 8 <= n; i += 8) {
+		v = _mm_loadu_si128((const __m128i *) (sp + i*2));
+		v = _mm_sub_epi16(v, vb);
+		v = _mm_max_epi16(v, _mm_sub_epi16(zero, v));
+		_mm_storeu_si128((__m128i *) (out + i), v);
+	}
+	fe_mag_scalar(sp + i*2, out + i, n - i, bias);
+}
+
+__attribute__((target("avx2")))
+static void fe_mag_avx2(const unsigned char *sp, int16_t *out,
+    unsigned int n, unsigned int bias)
+{
+	__m256i vb, v0, v1;
+	unsigned int i;
+
+	vb = _mm256_set1_epi16(bias);
+	for (i = 0; i + 32 <= n; i += 32) {
+		v0 = _mm256_loadu_si256((const __m256i *) (sp + i*2));
+		v1 = _mm256_loadu_si256((const __m256i *) (sp + i*2 + 32));
+		v0 = _mm256_abs_epi16(_mm256_sub_epi16(v0, vb));
+		v1 = _mm256_abs_epi16(_mm256_sub_epi16(v1, vb));
+		_mm256_storeu_si256((__m256i *) (out + i), v0);
+		_mm256_storeu_si256((__m256i *) (out + i + 16), v1);
+	}
+	fe_mag_sse2(sp + i*2, out + i, n - i, bias);
+}
+
+static int fe_usable_sse2(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static int fe_usable_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
+/*
+ * From the slowest to the fastest. The last usable one wins.
+ */
+const struct fe_impl fe_impl_vec[] = {
+	{ "scalar", fe_mag_scalar, fe_usable_always },
+#if FE_X86
+	{ "sse2",   fe_mag_sse2,   fe_usable_sse2 },
+	{ "avx2",   fe_mag_avx2,   fe_usable_avx2 },
+#endif
+	{ NULL, NULL, NULL }
+};
+
+void fe_init(void)
+{
+	const struct fe_impl *fp;
+
+	if (fe_mag != NULL)
+		return;
+#if FE_X86
+	__builtin_cpu_init();
+#endif
+	for (fp = fe_impl_vec; fp->name != NULL; fp++) {
+		if ((*fp->usable)()) {
+			fe_mag = fp->mag;
+			fe_name = fp->name;
+		}
+	}
+}
@@ -0,0 +1,26 @@
+/*
+ * The front end: raw samples to magnitudes, a whole transfer at a time
+ *
+ * The input is little-endian 16-bit raw samples with 12 significant bits,
+ * the output is |sample - bias|. All versions give identical results.
+ */
+
+#include <stdint.h>
+
+typedef void fe_mag_fn(const unsigned char *sp, int16_t *out, unsigned int n,
+    unsigned int bias);
+
+struct fe_impl {
+	const char *name;
+	fe_mag_fn *mag;
+	int (*usable)(void);
+};
+
+// The best implementation that this CPU runs, set by fe_init().
+extern fe_mag_fn *fe_mag;
+extern const char *fe_name;
+
+// All implementations that were built, terminated by a NULL name.
+extern const struct fe_impl fe_impl_vec[];
+
+void fe_init(void);
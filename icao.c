@@ -0,0 +1,115 @@
+/*
+ * The cache of ICAO addresses seen recently in frames with a plain parity
+ */
+
+#include "icao.h"
+
+/*
+ * A slot is: the valid bit 63, the address in bits 39-62, and the time
+ * in units of 64k samples in bits 0-38. A zero slot is free. The time
+ * unit is 3.3 ms at 20 Ms/s, plenty for the expiry in seconds, and the
+ * field wraps after thousands of years.
+ */
+#define ICAO_VALID     (1ULL << 63)
+#define ICAO_ASHIFT    39
+#define ICAO_TSHIFT    16
+#define ICAO_TMASK     ((1ULL << ICAO_ASHIFT) - 1)
+
+#define SLOT_ADDR(v)   ((uint32_t) ((v) >> ICAO_ASHIFT) & 0xFFFFFF)
+#define SLOT_TIME(v)   (((v) & ICAO_TMASK) << ICAO_TSHIFT)
+
+static inline unsigned int icao_hash(uint32_t addr)
+{
+	return (addr * 0x9E3779B1u) >> 17;	// 15 bits for ICAO_SIZE
+}
+
+static inline int slot_live(const struct icao *ic, uint64_t v, uint64_t now)
+{
+	return v != 0 && now - SLOT_TIME(v) < ic->ttl;
+}
+
+void icao_init(struct icao *ic, uint64_t ttl)
+{
+	unsigned int i;
+
+	ic->ttl = ttl;
+	for (i = 0; i < ICAO_SIZE; i++)
+		atomic_init(&ic->vec[i], 0);
+}
+
+/*
+ * Refresh the address if it's in the run, else take the first free or
+ * expired slot. If the whole run is live, the oldest one is evicted,
+ * so the run never grows and the lookup is bounded.
+ */
+void icao_add(struct icao *ic, uint32_t addr, uint64_t now)
+{
+	unsigned int h, i, x, best;
+	uint64_t v, best_t;
+	int dead;
+
+	h = icao_hash(addr);
+	best = h;
+	best_t = UINT64_MAX;
+	dead = 0;
+	for (i = 0; i < ICAO_PROBE; i++) {
+		x = (h + i) & (ICAO_SIZE - 1);
+		v = atomic_load_explicit(&ic->vec[x], memory_order_relaxed);
+		if (v == 0) {
+			// Nobody's beyond a free slot, so the address is not.
+			if (!dead)
+				best = x;
+			break;
+		}
+		if (SLOT_ADDR(v) == addr) {
+			best = x;
+			break;
+		}
+		if (dead)
+			continue;
+		if (!slot_live(ic, v, now)) {
+			best = x;
+			dead = 1;
+		} else if (SLOT_TIME(v) < best_t) {
+			best = x;
+			best_t = SLOT_TIME(v);
+		}
+	}
+	v = ICAO_VALID | (uint64_t) addr << ICAO_ASHIFT |
+	    ((now >> ICAO_TSHIFT) & ICAO_TMASK);
+	atomic_store_explicit(&ic->vec[best], v, memory_order_relaxed);
+}
+
+/*
+ * Expired slots are skipped and not freed, because a free slot would
+ * cut the run short. The adder reuses them.
+ */
+int icao_seen(const struct icao *ic, uint32_t addr, uint64_t now)
+{
+	unsigned int h, i;
+	uint64_t v;
+
+	h = icao_hash(addr);
+	for (i = 0; i < ICAO_PROBE; i++) {
+		v = atomic_load_explicit(&ic->vec[(h + i) & (ICAO_SIZE - 1)],
+		    memory_order_relaxed);
+		if (v == 0)
+			return 0;
+		if (SLOT_ADDR(v) == addr)
+			return slot_live(ic, v, now);
+	}
+	return 0;
+}
+
+unsigned int icao_count(const struct icao *ic, uint64_t now)
+{
+	unsigned int i, n;
+
+	n = 0;
+	for (i = 0; i < ICAO_SIZE; i++) {
+		if (slot_live(ic, atomic_load_explicit(&ic->vec[i],
+		    memory_order_relaxed), now))
+			n++;
+	}
+	return n;
+}
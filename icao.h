@@ -0,0 +1,25 @@
+/*
+ * The cache of ICAO addresses seen recently in frames with a plain parity
+ *
+ * Most downlink formats overlay the parity with the address, so the best
+ * we can do is to check that the address is one of the aircraft we heard.
+ * The table is fixed in size and open-addressed. Every slot is one 64-bit
+ * word with the address and the time, so readers in any thread need no
+ * locks. Only one thread may add. The time is the running sample count.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define ICAO_SIZE   32768	// a power of 2, three times 10k aircraft
+#define ICAO_PROBE  16		// the longest run of slots for an address
+
+struct icao {
+	uint64_t ttl;		// in samples
+	_Atomic uint64_t vec[ICAO_SIZE];
+};
+
+void icao_init(struct icao *ic, uint64_t ttl);
+void icao_add(struct icao *ic, uint32_t addr, uint64_t now);
+int icao_seen(const struct icao *ic, uint32_t addr, uint64_t now);
+unsigned int icao_count(const struct icao *ic, uint64_t now);
@@ -2,24 +2,91 @@
  * airspy_yoga
  */
 
+#define _GNU_SOURCE	// pthread_setaffinity_np
+
+#include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
 
 #include <airspy.h>
 
+#include "air.h"
+#include "bq.h"
+#include "crc.h"
+#include "icao.h"
+#include "net.h"
+#include "out.h"
+#include "rec.h"
+#include "ring.h"
+#include "snap.h"
 #include "upd.h"
 #include "yoga.h"
 
 #define TAG "airspy_yoga"
 
+/*
+ * The replay feeds transfers of this many samples, unless told otherwise.
+ * This is what libairspy hands us with AIRSPY_SAMPLE_RAW and no packing.
+ */
+#define REPLAY_BLK  131072
+
+/*
+ * The clock is anchored once per second of samples, and the statistics
+ * are printed every 10 seconds of samples.
+ */
+#define ANCHOR_INTERVAL(rsp)  ((rsp)->var->srate)
+#define TIMER_INTERVAL(rsp)   (10*(uint64_t)(rsp)->var->srate)
+
+/*
+ * The sources of samples: the devices, the recordings, and the pipes.
+ */
+#define SRC_MAX  8
+
+/*
+ * The sources only agree on the wall clock, and not better than the USB
+ * delivers their transfers. The same frame from two of them is dropped
+ * within this window. A repeat from the same source always goes out.
+ */
+#define MERGE_US  10000
+
+// The merge waits for a device that lags behind by this much at most, ms.
+#define MERGE_LAG  1000
+
 struct param {
 	int mode_capture;
 	int short_ok;
+	int stamp;
+	int beast;
+	int nlisten;
+	struct {
+		enum out_fmt fmt;
+		int port;
+	} lv[NET_LMAX];
+	unsigned int nbq;	// queued blocks, 0 to decode in the callback
+	int nwork;		// decoders, more than 1 to decode in parallel
+	int cpu;		// to pin the first decoder to, or -1
+	int nsrc;
+	struct {
+		char *name;	// a recording, "-" for stdin, NULL for a device
+		uint64_t serial;	// of the device, 0 for any
+	} sv[SRC_MAX];
+	unsigned int replay_blk;	// in samples
+	char *rec_name;
+	char *json_name;
+	char *bin_name;
+	const struct dvar *var;
+	int fix_bits;
+	int soft_bits;
+	long dup_us;
 	int lna_gain;
 	int mix_gain;
 	int vga_gain;
@@ -27,16 +94,12 @@ struct param {
 
 static struct param par;
 
-/* Only accessed by the receiving thread, not locked. */
-static struct rstate rs;
+/* What the main thread printed last time, summed over the workers. */
+static struct dstats st_last;
 
 static pthread_mutex_t rx_mutex;
 static pthread_cond_t rx_cond;
 
-unsigned long sample_count;
-unsigned long error_count;
-struct timeval count_last;
-
 struct cap1 {
 	int bias;
 	unsigned int len;	// in samples, not bytes
@@ -44,174 +107,279 @@ struct cap1 {
 };
 
 struct pack1 {
-	struct pack1 *next;
 	unsigned int plen;
 	unsigned char packet[112/8];
+	uint64_t ts;		// sample index of the preamble
+	int level;		// of the preamble pulses, 0..2047
+	int clean;		// for dec_addr(), with the parallel decoding
 
 	int avg_p;
-	unsigned long timed_n, timed_e;
+	struct rec_stats timed_w;
+	struct bq_stats bq;
+
+	int eob;		// the end of a block, at ts
 };
 
 struct cap1 *pcap;
-unsigned int pcnt;
-struct pack1 *phead, *ptail;
 
-static void rstate_hunt(struct rstate *rsp);
-static void packet_deliver(struct rstate *rsp);
-static void packet_timer(struct rstate *rsp, unsigned long n, unsigned long e);
+/*
+ * Packets go from the receiving thread to the main thread through a ring
+ * of preallocated slots. The eventfd is kicked once per transfer at most.
+ */
+#define PRING  4096
+
+/*
+ * The receiving context: the decoder state and the ring of its packets.
+ * Only its receiving thread touches it, except for the ring and for the
+ * published copy of the statistics. Every source has one, unless the
+ * blocks are decoded in parallel, and then every worker has its own.
+ */
+#define RX_WMAX  8
+
+struct rx {
+	struct rstate rs;
+	struct dstats_pub pub;	// the copy of rs.st for the main thread
+	uint64_t anchor_next, timer_next;
+	int timer;		// sends the timer packets
+	int kick;
+	struct ring pring;
+	struct pack1 pvec[PRING];
+	struct bq bq;		// with the pipeline
+	pthread_t thread;
+	int cpu;		// to pin the thread to, or -1
+};
+
+/*
+ * A source: a device, or a file that the replay thread reads in place of
+ * the libairspy thread. A recording is mapped, and its samples run on
+ * a clock of their own, from the time we started, so that the recordings
+ * made together line up. A pipe is read, and is stamped on arrival, like
+ * a device.
+ *
+ * With the pipeline, the decoder threads are the receiving threads, and
+ * the libairspy or the replay thread only puts transfers into the queues.
+ * The history is what the parallel decoding puts in front of the next
+ * block.
+ */
+struct src {
+	unsigned int tag;	// in the output, 0 if it's the only source
+	char *name;		// the file, "-" for stdin, NULL for a device
+	uint64_t serial;	// of the device, 0 for any
+	struct airspy_device *device;
+	struct rx *rxv;		// par.nwork of them
+	struct icao icao;	// the addresses, see rx_init()
+
+	// The replay
+	unsigned char *base;	// the mapped file, or NULL for a pipe
+	size_t len;		// in bytes
+	int fd;			// of the pipe
+	unsigned char *buf;	// a transfer read from the pipe
+	uint64_t rt0;		// CLOCK_REALTIME of the first sample, in ns
+	int (*rx_cb)(airspy_transfer_t *xfer);
+	pthread_t thread;
+	unsigned long samples;
+	double secs;
+	int done;		// locked by rx_mutex
+
+	// The producer of the parallel decoding
+	unsigned char *fan_hist;
+	uint64_t fan_n;		// samples so far
+	unsigned long fan_seq;	// blocks queued so far
+	unsigned long fan_skip;	// samples dropped since the last block
+	unsigned int fan_bias, fan_bias_timer;
+
+	// The main thread
+	unsigned long merge_seq;
+	int wait;		// for the frames up to the horizon
+	uint64_t horizon;	// the sample that it decoded up to
+	struct dstats stv[RX_WMAX];
+	uint64_t merge_win;	// the window for the repeats, in samples
+	struct dup1 merge_dupv[1 << DUP_BITS];
+};
+
+static struct src srcv[SRC_MAX];
+static unsigned int fan_pre;	// samples in the history
+static int rx_efd;
+
+static struct rec rec;
+
+static struct out out;
+static struct net net;
+static struct air air;		// the main thread only
+static struct snap snap;
+static unsigned long frames_out;	// the main thread only
+static uint64_t frames_ms;		// of the newest frame, the same
+static uint64_t rt_start;	// CLOCK_REALTIME when we started, in ns
 
 /*
- * We're treating the offset by 0x800 as a part of the DC bias.
+ * A worker cannot see the addresses and the repeats in the blocks of
+ * others, so the main thread checks them once the blocks are merged.
+ * The sources, which hear the same aircraft, are checked for the repeats
+ * again.
  */
-#define BVLEN  (128)
-static unsigned int dc_bias = 0x800;
+static struct dup1 src_dupv[1 << DUP_BITS];
+static unsigned long merge_dups, merge_unknown;
+
+static void packet_deliver(struct rstate *rsp);
+static int packet_room(struct rx *rxp);
+static void packet_timer(struct rx *rxp);
+static void packet_eob(struct rx *rxp, uint64_t end);
 
 static void Usage(void) {
-	fprintf(stderr, "Usage: airspy_yoga [-c pre|NNNN] [-S]"
-            " [-ga lna_gain] [-gm mix_gain] [-gv vga_gain]\n");
+	fprintf(stderr, "Usage: airspy_yoga [-c pre|NNNN] [-S] [-T|-B] [-R 20|12|10]"
+            " [-F 0|1|2] [-K 0|1|2|3] [-D usec]"
+            " [-l avr|avrt|beast|sbs:port]"
+            " [-ga lna_gain] [-gm mix_gain] [-gv vga_gain]"
+            " [-j file.json [-J file.bin]] [-P nbuf [-W nwork] [-A cpu]]"
+            " [-s serial]... [-r file.raw|- [-b NNNN]]... [-w file.raw]\n");
 	exit(1);
 }
 
-// Method Zero: direct calculation of the average
-#if 1
-static unsigned int bias_timer;
-static unsigned int dc_bias_update(unsigned char *sp)
+static unsigned long ts_ns(struct timespec *tp)
 {
-	int i;
-	unsigned int sum;
+	return tp->tv_sec * 1000000000UL + tp->tv_nsec;
+}
 
-	sum = 0;
-	for (i = 0; i < BVLEN; i++) {
-		sum += ((unsigned int) sp[1])<<8 | sp[0];
-		sp += 2;
+/*
+ * The transfer arrives when its last sample is taken, more or less.
+ * Without the pipeline, this is the only place where the receiving thread
+ * looks at a clock. With it, the queue stamps the transfer on arrival.
+ */
+static void rx_anchor(struct rstate *rsp, const struct bq_blk *bp,
+    unsigned int n)
+{
+	struct timespec rt, mono;
+
+	if (bp != NULL) {
+		rsp->st.anchor_n = bp->at_n;
+		rsp->st.anchor_rt = bp->rt;
+		rsp->st.anchor_mono = bp->mono;
+		return;
 	}
-	return sum / BVLEN;
+	clock_gettime(CLOCK_REALTIME, &rt);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	rsp->st.anchor_n = rsp->clock + n;
+	rsp->st.anchor_rt = ts_ns(&rt);
+	rsp->st.anchor_mono = ts_ns(&mono);
 }
-#endif
 
-// Method B: optimized with no loop
-#if 0
-static unsigned short bvec_b[BVLEN];
-static unsigned int bvx_b;
-static unsigned int bcur;
-static inline unsigned int dc_bias_update_b(unsigned int sample)
+/*
+ * Decode a transfer on the receiving thread. The bp is NULL when we run
+ * in the callback of libairspy.
+ */
+static void rx_decode(struct rx *rxp, unsigned char *samples, unsigned int n,
+    const struct bq_blk *bp)
 {
-	unsigned int bsub;
-
-	bsub = bvec_b[bvx_b];
-	bvec_b[bvx_b] = sample;
-	bvx_b = (bvx_b + 1) % BVLEN;
+	struct rstate *rsp = &rxp->rs;
+
+	if (bp != NULL && par.nwork != 1)
+		rsp->dc_bias = bp->bias;
+	else
+		dec_bias(rsp, samples, n);
+
+	// Published at once, so that the frames never come before it.
+	if (rsp->clock >= rxp->anchor_next) {
+		rx_anchor(rsp, bp, n);
+		rxp->anchor_next += ANCHOR_INTERVAL(rsp);
+		stats_publish(&rxp->pub, &rsp->st);
+	}
+	if (rxp->timer && rsp->clock >= rxp->timer_next) {
+		if (rxp->timer_next != 0)
+			packet_timer(rxp);
+		rxp->timer_next += TIMER_INTERVAL(rsp);
+	}
 
-	bcur -= bsub;	// overflows the unsigned, but it's all right
-	bcur += sample;
-	// if (bcur >= 0x1000)
-	// 	return 0x800;
-	return bcur / BVLEN;
+	dec_block(rsp, samples, n);
+	stats_publish(&rxp->pub, &rsp->st);
 }
-static void dc_bias_init_b(void)
+
+static void rx_kick(struct rx *rxp)
 {
-	int i;
-	for (i = 0; i < BVLEN; i++)
-		bvec_b[i] = dc_bias;
-	bcur = dc_bias * BVLEN;
+
+	if (rxp->kick) {
+		rxp->kick = 0;
+		eventfd_write(rx_efd, 1);
+	}
 }
-#endif
 
-static int rx_callback(airspy_transfer_t *xfer)
+/*
+ * The parallel decoding: the stream is cut into blocks, which go to the
+ * workers in turn. Every block carries the samples before it: a whole
+ * frame that the block before could not finish, and a little more for
+ * the decoder to settle. A block owns the frames that start from a frame
+ * before its first sample up to a frame before its end, so every frame
+ * has exactly one owner, and the owner sees all of it.
+ *
+ * The transfers are cut into blocks that fit into a buffer, which has
+ * the room for the prefix on top, and a block is dropped alone if its
+ * queue is full.
+ */
+static void rx_fan(struct src *srcp, const unsigned char *sp, unsigned int n)
 {
-	struct timeval now;
-	unsigned char *sp;
-	unsigned int sample;
-	int value, p;
-	int i;
-
-#if 1 /* Method Zero */
-	if (bias_timer == 0) {
-		if (xfer->sample_count >= BVLEN) {
-			sp = xfer->samples;
-			dc_bias = dc_bias_update(sp);
+	const unsigned int P = fan_pre;
+	unsigned char *hist = srcp->fan_hist;
+	struct bq_blk hdr;
+	struct timespec rt, mono;
+	unsigned int off, m, pre, k;
+
+	// The bias goes with the transfers, as it does for a single decoder.
+	bias_update(&srcp->fan_bias, &srcp->fan_bias_timer, sp, n);
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	memset(&hdr, 0, sizeof(struct bq_blk));
+	hdr.bias = srcp->fan_bias;
+	hdr.at_n = srcp->fan_n + n;
+	hdr.rt = ts_ns(&rt);
+	hdr.mono = ts_ns(&mono);
+
+	for (off = 0; off < n; off += m) {
+		m = n - off;
+		if (m > BQ_BUFSZ/2)
+			m = BQ_BUFSZ/2;
+		pre = (srcp->fan_n + off < P) ? srcp->fan_n + off : P;
+		k = (off < pre) ? off : pre;	// of the prefix, in sp
+		hdr.pre = pre;
+		hdr.len = m;
+		hdr.n0 = srcp->fan_n + off;
+		hdr.skip = srcp->fan_skip;
+		if (bq_put_blk(&srcp->rxv[srcp->fan_seq % par.nwork].bq, &hdr,
+		    hist + (P - (pre - k)) * 2, pre - k,
+		    sp + (off - k) * 2, k + m) == 0) {
+			srcp->fan_seq++;
+			srcp->fan_skip = 0;
+		} else {
+			srcp->fan_skip += m;
 		}
 	}
-	bias_timer = (bias_timer + 1) % 10;
-#endif
 
-	gettimeofday(&now, NULL);
-	if (now.tv_sec >= count_last.tv_sec + 10) {
-		packet_timer(&rs, sample_count, error_count);
-		sample_count = 0;
-		error_count = 0;
-		count_last = now;
+	if (n >= P) {
+		memcpy(hist, sp + (n - P) * 2, P * 2);
+	} else {
+		memmove(hist, hist + n * 2, (P - n) * 2);
+		memcpy(hist + (P - n) * 2, sp, n * 2);
 	}
+	srcp->fan_n += n;
+}
 
-	sp = xfer->samples;
-	for (i = 0; i < xfer->sample_count; i++) {
+static int rx_callback(airspy_transfer_t *xfer)
+{
+	struct src *srcp = xfer->ctx;
 
-		// You'll never believe it, but loading shorts like this
-		// is not at all faster than the facilities of <endian.h>.
-		// #include <endian.h>
-		// unsigned short int sp;
-		// sample = le16toh(*sp);
-		sample = sp[1]<<8 | sp[0];
-#if 0 /* Method B */
-		dc_bias = dc_bias_update_b(sample);
-#endif
-		value = (int) sample - (int) dc_bias;
-		p = upd_ate(&rs.smoo, abs(value));
-
-		if (rs.state == HUNT) {
-			if (++rs.dec >= DF) {
-				if (preamble_match(&rs, p)) {
-					rs.state = HALF;
-					rs.data_len = 56;
-					rs.bit_cnt = 0;
-					memset(rs.packet, 0, 112/8);
-				}
-				rs.dec = 0;
-			}
-		} else if (rs.state == HALF) {
-			if (++rs.dec >= SPB/2) {
-				rs.p_half = p;
-				rs.state = DATA;
-				rs.dec = 0;
-			}
-		} else {
-			if (++rs.dec >= SPB/2) {
-				if (bit_decode(&rs, p) == 0) {
-					if (++rs.bit_cnt >= rs.data_len) {
-						if (rs.data_len == 56 &&
-						    (rs.packet[0] & 0x80) != 0)
-						{
-							rs.data_len = 112;
-							rs.state = HALF;
-						} else {
-							packet_deliver(&rs);
-							rstate_hunt(&rs);
-						}
-					} else {
-						rs.state = HALF;
-					}
-				} else {
-					/*
-					 * Not sure if we should skip
-					 * up to data_len bits here.
-					 * For simplicity, we just go to HUNT.
-					 */
-					rstate_hunt(&rs);
-					pthread_mutex_lock(&rx_mutex);
-					error_count++;
-					pthread_mutex_unlock(&rx_mutex);
-				}
-				rs.dec = 0;
-			}
-		}
+	// Before the queue, so that what it drops is still recorded.
+	if (par.rec_name != NULL)
+		rec_put(&rec, xfer->samples, xfer->sample_count * 2);
 
-		sp += 2;
+	if (par.nwork != 1) {
+		rx_fan(srcp, xfer->samples, xfer->sample_count);
+	} else if (par.nbq != 0) {
+		bq_put(&srcp->rxv[0].bq, xfer->samples, xfer->sample_count);
+	} else {
+		rx_decode(&srcp->rxv[0], xfer->samples, xfer->sample_count,
+		    NULL);
+		rx_kick(&srcp->rxv[0]);
 	}
 
-	pthread_mutex_lock(&rx_mutex);
-	sample_count += xfer->sample_count;
-	pthread_mutex_unlock(&rx_mutex);
-
 	// We are supposed to return -1 if the buffer was not processed, but
 	// we don't see how this can ever be useful. What is the library
 	// going to do with this indication? Stop the streaming?
@@ -219,117 +387,205 @@ static int rx_callback(airspy_transfer_t *xfer)
 }
 
 /*
- * We're promiscuous with the manchester, by accepting any level change.
- * But we may change to only accept the levels used by preamble_match().
+ * Decode a block from the queue. If it does not follow the last one,
+ * because the queue dropped transfers or because the blocks go to other
+ * workers in between, the clock jumps and any match in progress is stale.
+ * The dropped samples are counted, so that the times of the frames and
+ * of the expiration agree; the prefix is counted by the block before.
  */
-int bit_decode(struct rstate *rsp, int p)
+static void rx_block(struct rx *rxp, const struct bq_blk *bp)
 {
-	unsigned char bit;
+	struct rstate *rsp = &rxp->rs;
+	uint64_t start = bp->n0 - bp->pre;
+
+	if (rsp->clock != start) {
+		rstate_hunt(rsp);
+		rsp->clock = start;
+		while (rxp->anchor_next + ANCHOR_INTERVAL(rsp) <= start)
+			rxp->anchor_next += ANCHOR_INTERVAL(rsp);
+		while (rxp->timer &&
+		    rxp->timer_next + TIMER_INTERVAL(rsp) <= start)
+			rxp->timer_next += TIMER_INTERVAL(rsp);
+	}
+	rsp->st.samples += bp->skip;
+	rsp->st.samples -= bp->pre;
+	if (par.nwork != 1) {
+		rsp->own_lo = (bp->n0 < FRAME_MAX(rsp->var)) ? 0 :
+		    bp->n0 - FRAME_MAX(rsp->var);
+		rsp->own_hi = bp->n0 + bp->len - FRAME_MAX(rsp->var);
+	}
+	rx_decode(rxp, bp->buf, bp->pre + bp->len, bp);
+}
 
-	/*
-	 * Clearly bogus.
-	 */
-	if (rsp->p_half <= 0 || p <= 0)
-		return -1;
+static void *rx_thread(void *arg)
+{
+	struct rx *rxp = arg;
+	struct bq_blk *bp;
+	uint64_t end;
+	cpu_set_t set;
+	int rc;
 
-	/*
-	 * Manchester proper.
-	 */
-	if (rsp->p_half < p) {
-		bit = 0;
-	} else if (rsp->p_half > p) {
-		bit = 1;
-	} else {
-		return -1;
+	if (rxp->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(rxp->cpu, &set);
+		rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (rc != 0)
+			fprintf(stderr, TAG ": cannot pin the decoder to"
+			    " CPU %d: %s\n", rxp->cpu, strerror(rc));
 	}
 
-	/*
-	 * Save the bit.
-	 */
-	rsp->packet[rsp->bit_cnt >> 3] |= bit << (7 - (rsp->bit_cnt & 07));
-
-	return 0;
+	while ((bp = bq_get(&rxp->bq)) != NULL) {
+		rx_block(rxp, bp);
+		end = rxp->rs.own_hi;
+		bq_done(&rxp->bq);
+		if (par.nwork != 1)
+			packet_eob(rxp, end);
+		// The main thread may be waiting for this source to catch up.
+		if (par.nsrc != 1)
+			rxp->kick = 1;
+		rx_kick(rxp);
+	}
+	return NULL;
 }
 
 /*
- * Let's avoid triggering an erroneous match with stale samples.
+ * Only the producer of the queues calls this, once it stopped producing.
+ * Everything that was queued is decoded before we return.
  */
-static void rstate_hunt(struct rstate *rsp)
+static void rx_pipe_stop(struct src *srcp)
 {
+	int i;
 
-	rsp->tx = 0;
-	memset(rsp->tvec, 0, sizeof(struct track)*NT);
-
-	rsp->state = HUNT;
+	if (par.nbq == 0)
+		return;
+	for (i = 0; i < par.nwork; i++)
+		bq_close(&srcp->rxv[i].bq);
+	for (i = 0; i < par.nwork; i++)
+		pthread_join(srcp->rxv[i].thread, NULL);
 }
 
+/*
+ * The receiving context is the one that holds the rstate.
+ */
 static void packet_deliver(struct rstate *rsp)
 {
+	struct rx *rxp = container_of(rsp, struct rx, rs);
 	struct pack1 *pp;
+	int x;
 
-	if (rsp->data_len < 112 && !par.short_ok)
+	// The merge needs the short ones that fill the address cache.
+	if (rsp->data_len < 112 && !par.short_ok &&
+	    !(rsp->icao_p == NULL && rsp->clean))
 		return;
 
-	pp = malloc(sizeof(struct pack1));
-	if (pp == NULL)
+	// A file waits, see packet_room().
+	if (rxp->bq.wait)
+		x = packet_room(rxp);
+	else
+		x = ring_put_begin(&rxp->pring);
+	if (x == -1) {
+		rsp->st.drops++;
 		return;
+	}
+	pp = &rxp->pvec[x];
 	memset(pp, 0, sizeof(struct pack1));
 
-	pthread_mutex_lock(&rx_mutex);
-	if (pcap == NULL) {
+	pp->plen = rsp->data_len / 8;
+	memcpy(pp->packet, rsp->packet, pp->plen);
+	pp->ts = rsp->pre_n;
+	pp->level = rsp->pre_level;
+	pp->clean = rsp->clean;
 
-		pp->plen = rsp->data_len / 8;
-		memcpy(pp->packet, rsp->packet, pp->plen);
+	ring_put_end(&rxp->pring);
+	rxp->kick = 1;
+}
 
-		if (pcnt == 0) {
-			phead = pp;
-			ptail = pp;
-		} else {
-			ptail->next = pp;
-			ptail = pp;
+/*
+ * Any thread: the queue statistics, summed over the workers of all sources.
+ */
+static void rx_bq_stats(struct bq_stats *sp)
+{
+	struct bq_stats s;
+	int i, j;
+
+	memset(sp, 0, sizeof(struct bq_stats));
+	for (j = 0; j < par.nsrc; j++) {
+		for (i = 0; i < par.nwork; i++) {
+			bq_stats(&srcv[j].rxv[i].bq, &s);
+			sp->blocks += s.blocks;
+			sp->drops += s.drops;
+			sp->size += s.size;
+			if (s.hw > sp->hw)
+				sp->hw = s.hw;
 		}
-		pcnt++;
-
-		pthread_cond_broadcast(&rx_cond);
-	} else {
-		free(pp);
 	}
-	pthread_mutex_unlock(&rx_mutex);
 }
 
-static void packet_timer(struct rstate *rsp, unsigned long n, unsigned long e)
+/*
+ * The timer packet only carries what the decoder statistics do not have.
+ * The main thread fetches the statistics when it sees the packet.
+ * Only the first worker of the first source sends it.
+ */
+static void packet_timer(struct rx *rxp)
 {
+	struct rstate *rsp = &rxp->rs;
 	struct pack1 *pp;
+	int x;
 
-	pp = malloc(sizeof(struct pack1));
-	if (pp == NULL)
+	x = ring_put_begin(&rxp->pring);
+	if (x == -1) {
+		rsp->st.drops++;
 		return;
+	}
+	pp = &rxp->pvec[x];
 	memset(pp, 0, sizeof(struct pack1));
 
-	pthread_mutex_lock(&rx_mutex);
-	if (pcap == NULL) {
-
-		pp->plen = 0;
-		pp->timed_n = n;
-		pp->timed_e = e;
-		/*
-		 * This is obviously racy, rx_callback does not lock
-		 * before updating rs.smoo. But it's okay for our purpose.
-		 */
-		pp->avg_p = UPD_CUR(&rsp->smoo);
+	pp->plen = 0;
+	if (par.rec_name != NULL)
+		rec_stats(&rec, &pp->timed_w);
+	pp->avg_p = UPD_CUR(&rsp->smoo);
+	if (par.nbq != 0)
+		rx_bq_stats(&pp->bq);
 
-		if (pcnt == 0) {
-			phead = pp;
-			ptail = pp;
-		} else {
-			ptail->next = pp;
-			ptail = pp;
-		}
-		pcnt++;
+	ring_put_end(&rxp->pring);
+	rxp->kick = 1;
+}
 
-		pthread_cond_broadcast(&rx_cond);
+/*
+ * Wait for a slot in the ring. The main thread only waits for the worker
+ * that it merges, or for a source that lags behind the others, and not
+ * for this one, so the wait for the room is short.
+ */
+static int packet_room(struct rx *rxp)
+{
+	struct timespec ts;
+	int x;
+
+	while ((x = ring_put_begin(&rxp->pring)) == -1) {
+		eventfd_write(rx_efd, 1);
+		ts.tv_sec = 0;
+		ts.tv_nsec = 100000;
+		nanosleep(&ts, NULL);
 	}
-	pthread_mutex_unlock(&rx_mutex);
+	return x;
+}
+
+/*
+ * The main thread merges the workers by these, so it cannot be dropped.
+ */
+static void packet_eob(struct rx *rxp, uint64_t end)
+{
+	struct pack1 *pp;
+	int x;
+
+	x = packet_room(rxp);
+	pp = &rxp->pvec[x];
+	memset(pp, 0, sizeof(struct pack1));
+	pp->eob = 1;
+	pp->ts = end;
+
+	ring_put_end(&rxp->pring);
+	rxp->kick = 1;
 }
 
 /*
@@ -348,6 +604,7 @@ static int cap_timer;
 
 static struct cap1 *rx_get_capture(void)
 {
+	struct rstate *rsp = &srcv[0].rxv[0].rs;
 	struct cap1 *pc;
 	unsigned int len = CAPLEN;
 	unsigned int *pv, *pp;
@@ -356,7 +613,7 @@ static struct cap1 *rx_get_capture(void)
 	if (!pc)
 		return NULL;
 
-	pc->bias = dc_bias;
+	pc->bias = rsp->dc_bias;
 	pc->len = len;
 
 	/* Buffer is used in full. We do this only to catch calculation bugs. */
@@ -378,35 +635,28 @@ static struct cap1 *rx_get_capture(void)
 
 static int rx_callback_capture(airspy_transfer_t *xfer)
 {
+	struct rstate *rsp = &srcv[0].rxv[0].rs;
 	int i;
 	unsigned char *sp;
 	unsigned int sample;
 	int value, p;
 	int match;
 
-#if 1 /* Method Zero */
-	if (bias_timer == 0) {
-		if (xfer->sample_count >= BVLEN) {
-			sp = xfer->samples;
-			dc_bias = dc_bias_update(sp);
-		}
-	}
-	bias_timer = (bias_timer + 1) % 10;
-#endif
+	if (par.rec_name != NULL)
+		rec_put(&rec, xfer->samples, xfer->sample_count * 2);
+
+	dec_bias(rsp, xfer->samples, xfer->sample_count);
 
 	sp = xfer->samples;
 	for (i = 0; i < xfer->sample_count; i++) {
 
 		sample = sp[1]<<8 | sp[0];
-#if 0 /* Method B */
-		dc_bias = dc_bias_update_b(sample);
-#endif
-		value = (int) sample - (int) dc_bias;
-		p = upd_ate(&rs.smoo, abs(value));
+		value = (int) sample - (int) rsp->dc_bias;
+		p = upd_ate(&rsp->smoo, abs(value));
 
 		if (par.mode_capture == -1) {
 
-			match = preamble_match(&rs, p);
+			match = preamble_match(rsp, p);
 
 			capvv[capx] = value;
 			cappv[capx] = p;
@@ -445,18 +695,138 @@ static int rx_callback_capture(airspy_transfer_t *xfer)
 }
 
 static void parse(struct param *p, char **argv) {
-	char *arg;
+	char *arg, *s;
 	long lv;
 
 	memset(p, 0, sizeof(struct param));
 	p->lna_gain = 14;
 	p->mix_gain = 12;
 	p->vga_gain = 10;
+	p->replay_blk = REPLAY_BLK;
+	p->var = dvar_find(NULL);
+	p->fix_bits = 1;
+	p->soft_bits = SOFT_BITS_MAX;
+	p->dup_us = DUP_US;
+	p->nwork = 1;
+	p->cpu = -1;
 
 	argv++;
 	while ((arg = *argv++) != NULL) {
 		if (arg[0] == '-') {
 			switch (arg[1]) {
+			case 'b':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -b block size\n");
+					Usage();
+				}
+				lv = strtol(arg, NULL, 10);
+				if (lv <= 0 || lv >= 0x1000000) {
+					fprintf(stderr,
+					    TAG ": invalid -b block size\n");
+					Usage();
+				}
+				p->replay_blk = lv;
+				break;
+			case 'r':
+				if ((arg = *argv++) == NULL) {
+					fprintf(stderr,
+					    TAG ": missing -r file\n");
+					Usage();
+				}
+				if (p->nsrc == SRC_MAX) {
+					fprintf(stderr,
+					    TAG ": too many sources\n");
+					Usage();
+				}
+				p->sv[p->nsrc++].name = arg;
+				break;
+			case 's':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -s serial\n");
+					Usage();
+				}
+				if (p->nsrc == SRC_MAX) {
+					fprintf(stderr,
+					    TAG ": too many sources\n");
+					Usage();
+				}
+				p->sv[p->nsrc].serial = strtoull(arg, &s, 16);
+				if (*s != 0 || p->sv[p->nsrc].serial == 0) {
+					fprintf(stderr,
+					    TAG ": invalid -s serial\n");
+					Usage();
+				}
+				p->nsrc++;
+				break;
+			case 'w':
+				if ((arg = *argv++) == NULL) {
+					fprintf(stderr,
+					    TAG ": missing -w file\n");
+					Usage();
+				}
+				p->rec_name = arg;
+				break;
+			case 'j':
+				if ((arg = *argv++) == NULL) {
+					fprintf(stderr,
+					    TAG ": missing -j file\n");
+					Usage();
+				}
+				p->json_name = arg;
+				break;
+			case 'J':
+				if ((arg = *argv++) == NULL) {
+					fprintf(stderr,
+					    TAG ": missing -J file\n");
+					Usage();
+				}
+				p->bin_name = arg;
+				break;
+			case 'P':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -P buffer count\n");
+					Usage();
+				}
+				lv = strtol(arg, NULL, 10);
+				if (lv <= 0 || lv > BQ_NMAX || (lv & (lv-1))) {
+					fprintf(stderr,
+					    TAG ": invalid -P buffer count,"
+					    " must be a power of 2\n");
+					Usage();
+				}
+				p->nbq = lv;
+				break;
+			case 'A':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -A cpu\n");
+					Usage();
+				}
+				lv = strtol(arg, NULL, 10);
+				if (lv < 0 || lv >= CPU_SETSIZE) {
+					fprintf(stderr,
+					    TAG ": invalid -A cpu\n");
+					Usage();
+				}
+				p->cpu = lv;
+				break;
+			case 'W':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -W worker count\n");
+					Usage();
+				}
+				lv = strtol(arg, NULL, 10);
+				if (lv <= 0 || lv > RX_WMAX) {
+					fprintf(stderr,
+					    TAG ": invalid -W worker count\n");
+					Usage();
+				}
+				p->nwork = lv;
+				break;
 			case 'c':
 				if ((arg = *argv++) == NULL || *arg == '-') {
 					fprintf(stderr,
@@ -475,9 +845,96 @@ static void parse(struct param *p, char **argv) {
 					p->mode_capture = lv;
 				}
 				break;
+			case 'R':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -R sample rate\n");
+					Usage();
+				}
+				p->var = dvar_find(arg);
+				if (p->var == NULL) {
+					fprintf(stderr,
+					    TAG ": unsupported -R sample rate\n");
+					Usage();
+				}
+				break;
+			case 'F':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -F bits to fix\n");
+					Usage();
+				}
+				lv = strtol(arg, NULL, 10);
+				if (lv < 0 || lv > CRC_FIX_MAX) {
+					fprintf(stderr,
+					    TAG ": invalid -F bits to fix\n");
+					Usage();
+				}
+				p->fix_bits = lv;
+				break;
+			case 'K':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -K weak bits\n");
+					Usage();
+				}
+				lv = strtol(arg, NULL, 10);
+				if (lv < 0 || lv > SOFT_BITS_MAX) {
+					fprintf(stderr,
+					    TAG ": invalid -K weak bits\n");
+					Usage();
+				}
+				p->soft_bits = lv;
+				break;
+			case 'D':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -D window\n");
+					Usage();
+				}
+				p->dup_us = strtol(arg, NULL, 10);
+				if (p->dup_us < 0 || p->dup_us > 1000000) {
+					fprintf(stderr,
+					    TAG ": invalid -D window\n");
+					Usage();
+				}
+				break;
 			case 'S':
 				p->short_ok = 1;
 				break;
+			case 'T':
+				p->stamp = 1;
+				break;
+			case 'B':
+				p->beast = 1;
+				break;
+			case 'l':
+				if ((arg = *argv++) == NULL || *arg == '-') {
+					fprintf(stderr,
+					    TAG ": missing -l format:port\n");
+					Usage();
+				}
+				if (p->nlisten == NET_LMAX) {
+					fprintf(stderr,
+					    TAG ": too many -l listeners\n");
+					Usage();
+				}
+				if ((s = strchr(arg, ':')) == NULL) {
+					fprintf(stderr,
+					    TAG ": invalid -l format:port\n");
+					Usage();
+				}
+				*s++ = 0;
+				lv = strtol(s, NULL, 10);
+				if (out_fmt_find(arg,
+				    &p->lv[p->nlisten].fmt) != 0 ||
+				    lv <= 0 || lv > 65535) {
+					fprintf(stderr,
+					    TAG ": invalid -l format:port\n");
+					Usage();
+				}
+				p->lv[p->nlisten++].port = lv;
+				break;
 			case 'g':
 				/*
 				 * These gain values are interpreted by the
@@ -530,32 +987,624 @@ static void parse(struct param *p, char **argv) {
 	}
 }
 
-int main(int argc, char **argv) {
-	int rc;
-	struct airspy_device *device = NULL;
-	int (*rx_cb)(airspy_transfer_t *xfer);
-	int i;
+/*
+ * A file streams until it is consumed, and a device until it is stopped.
+ * Either way, the consumer picks up everything that the decoders produced.
+ */
+static int rx_streaming(void)
+{
+	struct src *sp;
+	int ret = 0;
+	int i, j;
 
-	pthread_mutex_init(&rx_mutex, NULL);
-	pthread_cond_init(&rx_cond, NULL);
-	upd_init(&rs.smoo, AVGLEN);
-#if 0 /* Method B */
-	dc_bias_init_b();
-#endif
+	pthread_mutex_lock(&rx_mutex);
+	for (j = 0; j < par.nsrc; j++) {
+		if (srcv[j].device == NULL && !srcv[j].done)
+			ret = 1;
+	}
+	if (pcap != NULL)
+		ret = 1;
+	pthread_mutex_unlock(&rx_mutex);
+	for (j = 0; j < par.nsrc; j++) {
+		sp = &srcv[j];
+		if (sp->device != NULL && airspy_is_streaming(sp->device))
+			ret = 1;
+		for (i = 0; i < par.nwork; i++) {
+			if (ring_count(&sp->rxv[i].pring) != 0)
+				ret = 1;
+		}
+	}
+	return ret;
+}
 
-	parse(&par, argv);
+/*
+ * The counters only: the clock anchors do not add up.
+ */
+static void dstats_add(struct dstats *sp, const struct dstats *st)
+{
+
+	sp->samples += st->samples;
+	sp->errors += st->errors;
+	sp->pre_hits += st->pre_hits;
+	sp->frames_56 += st->frames_56;
+	sp->frames_112 += st->frames_112;
+	sp->drops += st->drops;
+	sp->crc_bad += st->crc_bad;
+	sp->crc_fixed += st->crc_fixed;
+	sp->crc_soft += st->crc_soft;
+	sp->ap_unknown += st->ap_unknown;
+	sp->dups += st->dups;
+}
+
+/*
+ * Fetch the statistics of every worker of a source into stv, and their
+ * sum into sp. The sum takes the clock anchor of the first worker.
+ */
+static void rx_fetch(struct src *srcp, struct dstats *stv, struct dstats *sp)
+{
+	int i;
+
+	memset(sp, 0, sizeof(struct dstats));
+	for (i = 0; i < par.nwork; i++) {
+		stats_fetch(&srcp->rxv[i].pub, &stv[i]);
+		dstats_add(sp, &stv[i]);
+	}
+	sp->anchor_n = stv[0].anchor_n;
+	sp->anchor_rt = stv[0].anchor_rt;
+	sp->anchor_mono = stv[0].anchor_mono;
+}
+
+static void rx_loop_capture(void)
+{
+	int rc;
+	int i;
+
+	while (rx_streaming()) {
+		FILE *fp = stdout;
+		struct cap1 *pc;
+		int *vp, *pp;
+
+		pthread_mutex_lock(&rx_mutex);
+		pc = pcap;
+		pcap = NULL;
+		pthread_mutex_unlock(&rx_mutex);
+
+		if (pc != NULL) {
+			fprintf(fp, "# bias %d len %d\n",
+			    pc->bias, pc->len);
+			vp = (int *)pc->buf;
+			pp = (int *)pc->buf + pc->len;
+			for (i = 0; i < pc->len; i++) {
+				fprintf(fp, " %4d %6d\n", vp[i], pp[i]);
+			}
+			fflush(fp);
+			free(pc);
+		}
+
+		pthread_mutex_lock(&rx_mutex);
+		if (pcap == NULL && !srcv[0].done) {
+			rc = pthread_cond_wait(&rx_cond, &rx_mutex);
+			if (rc != 0) {
+				pthread_mutex_unlock(&rx_mutex);
+				fprintf(stderr,
+				   TAG "pthread_cond_wait() failed:"
+				   " %d\n", rc);
+				exit(1);
+			}
+		}
+		pthread_mutex_unlock(&rx_mutex);
+	}
+}
+
+/*
+ * With the Beast, the statistics go to stderr, to keep the stream binary.
+ * With the AVR, they go into the same buffer as the frames, in order.
+ * The decoder statistics are summed over all sources.
+ */
+static void print_stats(struct pack1 *pp)
+{
+	static struct net_stats net_last;
+	static struct air_stats air_last;
+	static unsigned long bq_drops;
+	struct dstats stv[RX_WMAX];
+	struct snap_stats sst;
+	char line[400];
+	struct dstats st, st1;
+	int n;
+	int j;
+
+	memset(&st, 0, sizeof(struct dstats));
+	for (j = 0; j < par.nsrc; j++) {
+		rx_fetch(&srcv[j], stv, &st1);
+		dstats_add(&st, &st1);
+	}
+	st.ap_unknown += merge_unknown;
+	st.dups += merge_dups;
+	n = snprintf(line, sizeof(line), "# samples %lu errors %lu avg_p %d"
+	    " pre %lu short %lu long %lu bad %lu fixed %lu soft %lu"
+	    " unk %lu dup %lu ovf %lu",
+	    st.samples - st_last.samples, st.errors - st_last.errors,
+	    pp->avg_p, st.pre_hits - st_last.pre_hits,
+	    st.frames_56 - st_last.frames_56,
+	    st.frames_112 - st_last.frames_112,
+	    st.crc_bad - st_last.crc_bad,
+	    st.crc_fixed - st_last.crc_fixed,
+	    st.crc_soft - st_last.crc_soft,
+	    st.ap_unknown - st_last.ap_unknown,
+	    st.dups - st_last.dups,
+	    st.drops - st_last.drops);
+	st_last = st;
+	if (par.rec_name != NULL) {
+		n += snprintf(line + n, sizeof(line) - n,
+		    " wr %llu stall %lu drop %lu",
+		    pp->timed_w.bytes, pp->timed_w.stalls, pp->timed_w.drops);
+	}
+	if (par.nbq != 0) {
+		n += snprintf(line + n, sizeof(line) - n,
+		    " q_hw %u/%u q_drop %lu",
+		    pp->bq.hw, pp->bq.size, pp->bq.drops - bq_drops);
+		bq_drops = pp->bq.drops;
+	}
+	n += snprintf(line + n, sizeof(line) - n,
+	    " ac %u global %lu local %lu cpr_bad %lu", air.count,
+	    air.st.global - air_last.global, air.st.local - air_last.local,
+	    air.st.bad - air_last.bad);
+	air_last = air.st;
+	if (net.nl != 0) {
+		n += snprintf(line + n, sizeof(line) - n,
+		    " net %lu conn %lu slow %lu",
+		    net.st.bytes - net_last.bytes,
+		    net.st.accepts - net_last.accepts,
+		    net.st.slow - net_last.slow);
+		net_last = net.st;
+	}
+	if (par.json_name != NULL) {
+		snap_stats(&snap, &sst);
+		n += snprintf(line + n, sizeof(line) - n,
+		    " snap %lu skip %lu", sst.written, sst.skipped);
+	}
+	n += snprintf(line + n, sizeof(line) - n, "\n");
+
+	if (par.beast)
+		fputs(line, stderr);
+	else
+		out_text(&out, line, n);
+}
+
+/*
+ * The wall clock of a sample, from the last anchor, or from the time
+ * we started for a recording.
+ */
+static uint64_t rx_realtime(const struct src *srcp, const struct dstats *st,
+    uint64_t n)
+{
+	const unsigned int srate = par.var->srate;
+
+	if (srcp->rt0 != 0)
+		return srcp->rt0 + (n / srate) * 1000000000 +
+		    (n % srate) * 1000000000 / srate;
+	return st->anchor_rt +
+	    ((int64_t) (n - st->anchor_n) * 1000000000) / srate;
+}
+
+/*
+ * The time of a sample in ms, for the table of aircraft. A single source
+ * counts its samples. Several sources share the wall clock instead.
+ */
+static uint64_t rx_ms(const struct src *srcp, const struct dstats *st,
+    uint64_t n)
+{
+	uint64_t rt;
+
+	if (par.nsrc == 1)
+		return n / (par.var->srate / 1000);
+	rt = rx_realtime(srcp, st, n);
+	return (rt > rt_start) ? (rt - rt_start) / 1000000 : 0;
+}
+
+/*
+ * The next frame of a source, or NULL if it has none yet. The packets
+ * that are not frames are taken care of on the way. With the parallel
+ * decoding, the blocks went to the workers in turn, so we take the
+ * packets from the workers in turn, a block at a time. The blocks own
+ * consecutive pieces of the stream, so the frames come out in the order
+ * of their time, as they do from a single decoder.
+ */
+static struct pack1 *rx_head(struct src *srcp, uint64_t now, uint64_t *rtp)
+{
+	struct pack1 *pp;
+	struct dstats *st;
+	struct rx *rxp;
+	int w;
+	int x;
+
+	for (;;) {
+		w = srcp->merge_seq % par.nwork;
+		rxp = &srcp->rxv[w];
+		if ((x = ring_get_begin(&rxp->pring)) == -1)
+			return NULL;
+		pp = &rxp->pvec[x];
+		if (pp->plen)
+			break;
+		if (pp->eob) {
+			srcp->merge_seq++;
+			srcp->horizon = pp->ts;
+		} else {
+			air_expire(&air, now);
+			print_stats(pp);
+		}
+		ring_get_end(&rxp->pring);
+	}
+
+	// The anchor is published before any frame that needs it.
+	st = &srcp->stv[w];
+	if (st->anchor_rt == 0)
+		stats_fetch(&rxp->pub, st);
+	*rtp = rx_realtime(srcp, st, pp->ts);
+	return pp;
+}
+
+/*
+ * Send out the frame that rx_head() found, unless it's a repeat.
+ */
+static void rx_frame(struct src *srcp, struct pack1 *pp, uint64_t rt)
+{
+	int w = srcp->merge_seq % par.nwork;
+	struct rx *rxp = &srcp->rxv[w];
+	struct ofr fr;
+	uint64_t ms;
+
+	if (par.nwork != 1 &&
+	    dec_addr(&srcp->icao, pp->packet, pp->plen, pp->clean,
+	    pp->ts) != 0) {
+		merge_unknown++;
+	} else if (par.nwork != 1 &&
+	    dup_seen(srcp->merge_dupv, srcp->merge_win, pp->packet,
+	    pp->plen, pp->ts, -1)) {
+		merge_dups++;
+	} else if (pp->plen < 112/8 && !par.short_ok) {
+		;	// only for the address cache, see packet_deliver()
+	} else if (par.nsrc != 1 &&
+	    dup_seen(src_dupv, (uint64_t) MERGE_US * 1000, pp->packet,
+	    pp->plen, rt, srcp - srcv)) {
+		merge_dups++;
+	} else {
+		fr.pkt = pp->packet;
+		fr.plen = pp->plen;
+		fr.ts = ts_mlat(pp->ts, par.var->srate) & 0xFFFFFFFFFFFFULL;
+		fr.rssi = out_rssi(pp->level);
+		fr.rt = rt;
+		fr.src = srcp->tag;
+		ms = rx_ms(srcp, &srcp->stv[w], pp->ts);
+		if (ms > frames_ms)
+			frames_ms = ms;
+		fr.ap = air_update(&air, pp->packet, pp->plen, ms, fr.rssi);
+		out_frame(&out, &fr);
+		if (net.nl != 0)
+			net_frame(&net, &fr);
+		frames_out++;
+	}
+	ring_get_end(&rxp->pring);
+}
+
+/*
+ * How far a source decoded: the frames that are yet to come from it start
+ * later. A single decoder publishes after every block, so we take off
+ * a block, and a frame that the block did not finish. The parallel ones
+ * finish the blocks out of order, so their horizon is where the blocks
+ * that we merged end, see rx_head().
+ */
+static void rx_horizon(struct src *srcp, const struct dstats *st)
+{
+	uint64_t slack = BQ_BUFSZ/2 + FRAME_MAX(par.var);
+
+	if (par.nwork == 1)
+		srcp->horizon = (st->samples > slack) ? st->samples - slack : 0;
+}
+
+/*
+ * The sources are merged by the wall clock of their frames. A frame waits
+ * until the others decoded up to it, so that the output is in order, and
+ * the repeats of a frame come out next to each other. We do not wait for
+ * a source that ended, or for a device that lags too far behind.
+ */
+static void rx_loop_packets(void)
+{
+	uint64_t snap_next = 0;
+	uint64_t now = 0, now_rt = 0, t, rt, best_rt = 0;
+	struct timespec wall;
+	struct src *sp, *best;
+	struct pack1 *pp, *best_pp = NULL;
+	struct dstats st;
+	int idle, held;
+	int j;
+
+	for (;;) {
+		clock_gettime(CLOCK_REALTIME, &wall);
+		pthread_mutex_lock(&rx_mutex);
+		for (j = 0; j < par.nsrc; j++)
+			srcv[j].wait = (srcv[j].device != NULL ||
+			    !srcv[j].done);
+		pthread_mutex_unlock(&rx_mutex);
+		for (j = 0; j < par.nsrc; j++) {
+			sp = &srcv[j];
+			rx_fetch(sp, sp->stv, &st);
+			t = rx_ms(sp, &st, st.samples);
+			if (t >= now) {
+				now = t;
+				now_rt = rx_realtime(sp, &st, st.samples);
+			}
+			rx_horizon(sp, &st);
+			if (sp->rt0 == 0 &&
+			    rx_realtime(sp, &st, sp->horizon) +
+			    (uint64_t) MERGE_LAG * 1000000 < ts_ns(&wall))
+				sp->wait = 0;
+		}
+
+		held = 0;
+		for (;;) {
+			best = NULL;
+			for (j = 0; j < par.nsrc; j++) {
+				sp = &srcv[j];
+				pp = rx_head(sp, now, &rt);
+				if (pp != NULL &&
+				    (best == NULL || rt < best_rt)) {
+					best = sp;
+					best_pp = pp;
+					best_rt = rt;
+				}
+			}
+			if (best == NULL)
+				break;
+			for (j = 0; j < par.nsrc && par.nsrc != 1; j++) {
+				sp = &srcv[j];
+				if (sp != best && sp->wait &&
+				    rx_head(sp, now, &rt) == NULL &&
+				    rx_realtime(sp, &sp->stv[0], sp->horizon) <
+				    best_rt)
+					held = 1;
+			}
+			if (held)
+				break;
+			rx_frame(best, best_pp, best_rt);
+		}
+
+		// Once per second, and only the main thread does it.
+		// The frames drained above may be newer than the clock was.
+		if (par.json_name != NULL && now >= snap_next) {
+			snap_take(&snap, &air,
+			    (frames_ms > now) ? frames_ms : now,
+			    now_rt / 1000000, frames_out);
+			snap_next = now + 1000;
+		}
+
+		// One write for everything that came in since the last kick.
+		if (out_flush(&out) != 0) {
+			fprintf(stderr, TAG ": write error: %s\n",
+			    strerror(out.err));
+			exit(1);
+		}
+		net_flush(&net);
 
-	rc = airspy_init();
+		if (!rx_streaming())
+			break;
+
+		/*
+		 * A kick that comes after we drained the ring is not lost,
+		 * the eventfd keeps the count until we read it. Meanwhile,
+		 * the clients are served.
+		 */
+		idle = 1;
+		for (j = 0; j < par.nsrc && !held; j++) {
+			sp = &srcv[j];
+			if (ring_count(&sp->rxv[sp->merge_seq % par.nwork].pring)
+			    != 0)
+				idle = 0;
+		}
+		if (idle) {
+			if (net_wait(&net) != 0) {
+				fprintf(stderr, TAG ": epoll_wait() failed:"
+				    " %s\n", strerror(errno));
+				exit(1);
+			}
+		}
+	}
+}
+
+/*
+ * Find the index of the sample rate that the decoder variant wants.
+ * The library lists the IQ rates, such as 10 and 2.5 MHz for the Airspy R2,
+ * and the raw real samples come at twice that.
+ */
+static int rx_rate_index(struct airspy_device *device, unsigned int srate)
+{
+	uint32_t cnt;
+	uint32_t *vec;
+	int i;
+	int rc;
+
+	rc = airspy_get_samplerates(device, &cnt, 0);
 	if (rc != AIRSPY_SUCCESS) {
-		fprintf(stderr, TAG ": airspy_init() failed: %s (%d)\n",
+		fprintf(stderr,
+		    TAG ": airspy_get_samplerates() failed: %s (%d)\n",
 		    airspy_error_name(rc), rc);
-		goto err_init;
+		return -1;
+	}
+	vec = malloc(cnt * sizeof(uint32_t));
+	if (vec == NULL) {
+		fprintf(stderr, TAG ": No core\n");
+		return -1;
+	}
+	rc = airspy_get_samplerates(device, vec, cnt);
+	if (rc != AIRSPY_SUCCESS) {
+		fprintf(stderr,
+		    TAG ": airspy_get_samplerates() failed: %s (%d)\n",
+		    airspy_error_name(rc), rc);
+		free(vec);
+		return -1;
+	}
+	for (i = 0; i < cnt; i++) {
+		if ((uint64_t) vec[i] * 2 == srate) {
+			free(vec);
+			return i;
+		}
+	}
+	fprintf(stderr, TAG ": sample rate %u is not supported, have:", srate);
+	for (i = 0; i < cnt; i++)
+		fprintf(stderr, " %llu", (unsigned long long) vec[i] * 2);
+	fprintf(stderr, "\n");
+	free(vec);
+	return -1;
+}
+
+/*
+ * Read a whole transfer from a pipe, unless it ends first.
+ * Return the number of bytes, or -1.
+ */
+static ssize_t replay_read(int fd, unsigned char *buf, size_t len)
+{
+	size_t n = 0;
+	ssize_t rc;
+
+	while (n < len) {
+		rc = read(fd, buf + n, len - n);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (rc == 0)
+			break;
+		n += rc;
+	}
+	return n;
+}
+
+static void *replay_thread(void *arg)
+{
+	struct src *p = arg;
+	airspy_transfer_t xfer;
+	struct timespec t0, t1;
+	unsigned char *sp;
+	size_t left;		// in samples
+	unsigned int n;
+	ssize_t rc;
+
+	memset(&xfer, 0, sizeof(airspy_transfer_t));
+	xfer.sample_type = AIRSPY_SAMPLE_RAW;
+	xfer.ctx = p;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (p->base != NULL) {
+		sp = p->base;
+		left = p->len / 2;
+		while (left != 0) {
+			n = (left < par.replay_blk) ? left : par.replay_blk;
+			xfer.samples = sp;
+			xfer.sample_count = n;
+			(*p->rx_cb)(&xfer);
+			sp += n * 2;
+			left -= n;
+			p->samples += n;
+		}
+	} else {
+		while ((rc = replay_read(p->fd, p->buf,
+		    par.replay_blk * 2)) >= 2) {
+			xfer.samples = p->buf;
+			xfer.sample_count = rc / 2;
+			(*p->rx_cb)(&xfer);
+			p->samples += rc / 2;
+		}
+		if (rc < 0)
+			fprintf(stderr, TAG ": Cannot read %s: %s\n",
+			    p->name, strerror(errno));
 	}
+	rx_pipe_stop(p);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	p->secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
 
-	// open any device, result by reference
-	rc = airspy_open(&device);
+	pthread_mutex_lock(&rx_mutex);
+	p->done = 1;
+	pthread_cond_broadcast(&rx_cond);
+	pthread_mutex_unlock(&rx_mutex);
+	eventfd_write(rx_efd, 1);
+	return NULL;
+}
+
+/*
+ * Replay a recording of raw samples through the same callbacks that
+ * libairspy would invoke. The file is mapped, so transfers point right
+ * into the page cache and nothing gets copied on the way to the decoder.
+ * Anything that cannot be mapped, such as a pipe, is read.
+ */
+static int src_open_file(struct src *sp)
+{
+	struct stat st;
+	void *base;
+	int fd;
+
+	if (strcmp(sp->name, "-") == 0) {
+		fd = 0;
+	} else {
+		fd = open(sp->name, O_RDONLY);
+		if (fd == -1) {
+			fprintf(stderr, TAG ": Cannot open %s: %s\n",
+			    sp->name, strerror(errno));
+			return -1;
+		}
+	}
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, TAG ": Cannot stat %s: %s\n",
+		    sp->name, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		sp->buf = malloc(par.replay_blk * 2);
+		if (sp->buf == NULL) {
+			fprintf(stderr, TAG ": No core\n");
+			close(fd);
+			return -1;
+		}
+		sp->fd = fd;
+		return 0;
+	}
+	if (st.st_size < 2) {
+		fprintf(stderr, TAG ": File %s is empty\n", sp->name);
+		close(fd);
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, TAG ": Cannot map %s: %s\n",
+		    sp->name, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+	sp->base = base;
+	sp->len = st.st_size;
+	return 0;
+}
+
+/*
+ * Open a device by its serial number, or any if it's 0, and set it up.
+ */
+static int src_open_dev(struct src *sp)
+{
+	struct airspy_device *device = NULL;
+	int rc;
+
+	// result by reference
+	if (sp->serial != 0)
+		rc = airspy_open_sn(&device, sp->serial);
+	else
+		rc = airspy_open(&device);
 	if (rc != AIRSPY_SUCCESS) {
-		fprintf(stderr, TAG ": airspy_open() failed: %s (%d)\n",
+		fprintf(stderr, TAG ": airspy_open() of %016llx failed:"
+		    " %s (%d)\n", (unsigned long long) sp->serial,
 		    airspy_error_name(rc), rc);
 		goto err_open;
 	}
@@ -568,25 +1617,11 @@ int main(int argc, char **argv) {
 		goto err_sample;
 	}
 
-#if 0 /* We set to 20 million, index 0, which works on all firmware levels. */
-	uint32_t samplerates_count;
-	uint32_t *supported_samplerates;
-	airspy_get_samplerates(device, &samplerates_count, 0);
-	supported_samplerates = malloc(samplerates_count * sizeof(uint32_t));
-	airspy_get_samplerates(device,
-	    supported_samplerates, samplerates_count);
-
-	/* P3 */
-	printf("samplerate [%d]", samplerates_count);
-	for (i = 0; i < samplerates_count; i++) {
-		printf(" %u", supported_samplerates[i]);
-	}
-	printf("\n");
-	free(supported_samplerates);
-#endif
 	// Setting by value fails on firmware v1.0.0-rc4, so set by index.
-	// rc = airspy_set_samplerate(device, 20000000);
-	rc = airspy_set_samplerate(device, 0);
+	rc = rx_rate_index(device, par.var->srate);
+	if (rc < 0)
+		goto err_rate;
+	rc = airspy_set_samplerate(device, rc);
 	if (rc != AIRSPY_SUCCESS) {
 		fprintf(stderr,
 		    TAG ": airspy_set_samplerate() failed: %s (%d)\n",
@@ -680,126 +1715,297 @@ int main(int argc, char **argv) {
 		    airspy_error_name(rc), rc);
 	}
 
-	if (par.mode_capture) {
-		rx_cb = rx_callback_capture;
-	} else {
-		gettimeofday(&count_last, NULL);
-		rx_cb = rx_callback;
+	sp->device = device;
+	return 0;
+
+err_bias:
+err_packed:
+err_rate:
+err_sample:
+	airspy_close(device);
+err_open:
+	return -1;
+}
+
+static int src_open(struct src *sp)
+{
+	if (sp->name != NULL)
+		return src_open_file(sp);
+	return src_open_dev(sp);
+}
+
+static int src_start(struct src *sp, int (*rx_cb)(airspy_transfer_t *xfer))
+{
+	int rc;
+
+	if (sp->name != NULL) {
+		if (sp->base != NULL)
+			sp->rt0 = rt_start;
+		sp->rx_cb = rx_cb;
+		rc = pthread_create(&sp->thread, NULL, replay_thread, sp);
+		if (rc != 0) {
+			fprintf(stderr, TAG ": pthread_create() failed: %d\n",
+			    rc);
+			return -1;
+		}
+		return 0;
 	}
-	rc = airspy_start_rx(device, rx_cb, NULL);
+
+	rc = airspy_start_rx(sp->device, rx_cb, sp);
 	if (rc != AIRSPY_SUCCESS) {
 		fprintf(stderr, TAG ": airspy_start_rx() failed: %s (%d)\n",
 		    airspy_error_name(rc), rc);
-		goto err_start;
+		return -1;
 	}
 
 	// No idea why the frequency is set after the start of the receiving
-	rc = airspy_set_freq(device, 1090*1000000);
+	rc = airspy_set_freq(sp->device, 1090*1000000);
 	if (rc != AIRSPY_SUCCESS) {
 		fprintf(stderr, TAG ": airspy_set_freq() failed: %s (%d)\n",
 		    airspy_error_name(rc), rc);
-		goto err_freq;
+		airspy_stop_rx(sp->device);
+		return -1;
 	}
+	return 0;
+}
 
-	if (par.mode_capture) {
-		while (airspy_is_streaming(device)) {
-			FILE *fp = stdout;
-			struct cap1 *pc;
-			int *vp, *pp;
+static void src_close(struct src *sp)
+{
+	if (sp->device != NULL) {
+		airspy_stop_rx(sp->device);
+		rx_pipe_stop(sp);
+		airspy_close(sp->device);
+		sp->device = NULL;
+		return;
+	}
 
-			pthread_mutex_lock(&rx_mutex);
-			pc = pcap;
-			pcap = NULL;
-			pthread_mutex_unlock(&rx_mutex);
+	pthread_join(sp->thread, NULL);
+	if (sp->base != NULL)
+		munmap(sp->base, sp->len);
+	if (sp->buf != NULL) {
+		close(sp->fd);
+		free(sp->buf);
+	}
 
-			if (pc != NULL) {
-				fprintf(fp, "# bias %d len %d\n",
-				    pc->bias, pc->len);
-				vp = (int *)pc->buf;
-				pp = (int *)pc->buf + pc->len;
-				for (i = 0; i < pc->len; i++) {
-					fprintf(fp, " %4d %6d\n", vp[i], pp[i]);
-				}
-				fflush(fp);
-				free(pc);
+	fflush(stdout);
+	fprintf(stderr, TAG ": replayed %lu samples in %.3f s, %.2f Ms/s\n",
+	    sp->samples, sp->secs,
+	    (sp->secs > 0.0) ? sp->samples / sp->secs / 1e6 : 0.0);
+}
+
+/*
+ * Every source has a cache of addresses. A single decoder fills and checks
+ * it as it goes. The workers do not touch it: a reply in one block must be
+ * checked against the squitters that came in the others, so rx_frame()
+ * does it, in the order of the merge. The sources do not share a cache,
+ * they count time by their own samples.
+ */
+static int rx_init(void)
+{
+	struct src *sp;
+	struct rx *rxp;
+	int i, j;
+
+	fan_pre = FRAME_PRE(par.var);
+	for (j = 0; j < par.nsrc; j++) {
+		sp = &srcv[j];
+		sp->tag = (par.nsrc != 1) ? j + 1 : 0;
+		sp->name = par.sv[j].name;
+		sp->serial = par.sv[j].serial;
+		sp->fd = -1;
+		sp->fan_bias = 0x800;
+		sp->rxv = aligned_alloc(RING_CLSZ,
+		    par.nwork * sizeof(struct rx));
+		if (sp->rxv == NULL) {
+			fprintf(stderr, TAG ": No core\n");
+			return -1;
+		}
+		memset(sp->rxv, 0, par.nwork * sizeof(struct rx));
+		icao_init(&sp->icao, (uint64_t) ICAO_TTL * par.var->srate);
+
+		for (i = 0; i < par.nwork; i++) {
+			rxp = &sp->rxv[i];
+			if (rstate_init(&rxp->rs, par.var,
+			    packet_deliver) != 0) {
+				fprintf(stderr,
+				    TAG ": rstate_init() failed: No core\n");
+				return -1;
 			}
+			rxp->rs.fix_bits = par.fix_bits;
+			rxp->rs.soft_bits = par.soft_bits;
+			rxp->rs.dup_win =
+			    (uint64_t) par.dup_us * par.var->srate / 1000000;
+			if (par.nwork == 1)
+				rxp->rs.icao_p = &sp->icao;
+			else
+				rxp->rs.dup_win = 0;
+			ring_init(&rxp->pring, PRING);
+			rxp->timer = (j == 0 && i == 0);
+			rxp->cpu = (par.cpu >= 0) ?
+			    par.cpu + j * par.nwork + i : -1;
+		}
 
-			pthread_mutex_lock(&rx_mutex);
-			if (pcap == NULL) {
-				rc = pthread_cond_wait(&rx_cond, &rx_mutex);
-				if (rc != 0) {
-					pthread_mutex_unlock(&rx_mutex);
-					fprintf(stderr,
-					   TAG "pthread_cond_wait() failed:"
-					   " %d\n", rc);
-					exit(1);
-				}
+		if (par.nwork != 1) {
+			sp->merge_win =
+			    (uint64_t) par.dup_us * par.var->srate / 1000000;
+			sp->fan_hist = calloc(fan_pre, 2);
+			if (sp->fan_hist == NULL) {
+				fprintf(stderr, TAG ": No core\n");
+				return -1;
 			}
-			pthread_mutex_unlock(&rx_mutex);
 		}
-		airspy_stop_rx(device);
-		airspy_close(device);
-		airspy_exit();
-		exit(0);
 	}
+	return 0;
+}
 
-	while (airspy_is_streaming(device)) {
+static int rx_start(void)
+{
+	struct src *sp;
+	struct rx *rxp;
+	int i, j;
+	int rc;
 
-		pthread_mutex_lock(&rx_mutex);
-		while (pcnt) {
-			struct pack1 *pp;
+	for (j = 0; j < par.nsrc; j++) {
+		sp = &srcv[j];
+		for (i = 0; i < par.nwork; i++) {
+			rxp = &sp->rxv[i];
+			if (bq_init(&rxp->bq, par.nbq,
+			    (par.nwork != 1) ? fan_pre : 0) != 0)
+				return -1;
+			// A file is as fast as the decoders, and never drops.
+			rxp->bq.wait = (sp->name != NULL);
+			rc = pthread_create(&rxp->thread, NULL, rx_thread,
+			    rxp);
+			if (rc != 0) {
+				fprintf(stderr,
+				    TAG ": pthread_create() failed: %d\n", rc);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
 
-			--pcnt;
-			pp = phead;
-			phead = pp->next;
-			pthread_mutex_unlock(&rx_mutex);
+int main(int argc, char **argv) {
+	struct timespec rt;
+	int ndev;
+	int i;
+	int (*rx_cb)(airspy_transfer_t *xfer);
+	int rc;
 
-			if (pp->plen) {
-				printf("*");
-				for (i = 0; i < pp->plen; i++) {
-					printf("%02x", pp->packet[i]);
-				}
-				printf(";\n");
-			} else {
-				printf("# samples %lu errors %lu avg_p %d\n",
-				    pp->timed_n, pp->timed_e, pp->avg_p);
-			}
-			free(pp);
+	pthread_mutex_init(&rx_mutex, NULL);
+	pthread_cond_init(&rx_cond, NULL);
+	rx_efd = eventfd(0, 0);
+	if (rx_efd == -1) {
+		fprintf(stderr, TAG ": eventfd() failed: %s\n",
+		    strerror(errno));
+		return 1;
+	}
 
-			pthread_mutex_lock(&rx_mutex);
-		}
-		pthread_mutex_unlock(&rx_mutex);
+	parse(&par, argv);
+	// Without sources, any device.
+	if (par.nsrc == 0)
+		par.nsrc = 1;
+	if (par.nsrc != 1 && (par.mode_capture || par.rec_name != NULL)) {
+		fprintf(stderr, TAG ": -c and -w take a single source\n");
+		Usage();
+	}
+	if (par.mode_capture) {
+		par.nwork = 1;
+		par.nbq = 0;
+	}
+	// Several sources decode on threads of their own, so they can be
+	// pinned, and do not hold up the transfers of one another.
+	if ((par.nwork != 1 || par.nsrc != 1) && par.nbq == 0)
+		par.nbq = BQ_NBUF;
+
+	if (rx_init() != 0)
+		return 1;
+	air_init(&air);
+	out_init(&out, 1, par.beast ? OUT_BEAST :
+	    (par.stamp ? OUT_AVR_T : OUT_AVR));
+	if (net_init(&net, rx_efd) != 0)
+		return 1;
+	for (i = 0; i < par.nlisten; i++) {
+		if (net_listen(&net, par.lv[i].fmt, par.lv[i].port) != 0)
+			return 1;
+	}
 
-		pthread_mutex_lock(&rx_mutex);
-		if (pcnt == 0) {
-			rc = pthread_cond_wait(&rx_cond, &rx_mutex);
-			if (rc != 0) {
-				pthread_mutex_unlock(&rx_mutex);
-				fprintf(stderr,
-				   TAG "pthread_cond_wait() failed:"
-				   " %d\n", rc);
-				exit(1);
-			}
+	if (par.mode_capture)
+		rx_cb = rx_callback_capture;
+	else
+		rx_cb = rx_callback;
+
+	if (par.rec_name != NULL) {
+		if (rec_open(&rec, par.rec_name) != 0)
+			return 1;
+	}
+	if (par.json_name != NULL) {
+		if (snap_open(&snap, par.json_name, par.bin_name) != 0)
+			return 1;
+	}
+	if (par.nbq != 0) {
+		if (rx_start() != 0)
+			return 1;
+	}
+
+	ndev = 0;
+	for (i = 0; i < par.nsrc; i++) {
+		if (srcv[i].name == NULL)
+			ndev++;
+	}
+	if (ndev != 0) {
+		rc = airspy_init();
+		if (rc != AIRSPY_SUCCESS) {
+			fprintf(stderr,
+			    TAG ": airspy_init() failed: %s (%d)\n",
+			    airspy_error_name(rc), rc);
+			goto err_init;
 		}
-		pthread_mutex_unlock(&rx_mutex);
 	}
 
-	airspy_stop_rx(device);
+	for (i = 0; i < par.nsrc; i++) {
+		if (src_open(&srcv[i]) != 0)
+			goto err_open;
+	}
+	clock_gettime(CLOCK_REALTIME, &rt);
+	rt_start = ts_ns(&rt);
+	for (i = 0; i < par.nsrc; i++) {
+		if (src_start(&srcv[i], rx_cb) != 0)
+			goto err_start;
+	}
 
-	airspy_close(device);
-	airspy_exit();
+	if (par.mode_capture)
+		rx_loop_capture();
+	else
+		rx_loop_packets();
+
+	for (i = 0; i < par.nsrc; i++)
+		src_close(&srcv[i]);
+	if (ndev != 0)
+		airspy_exit();
+	if (par.rec_name != NULL)
+		rec_close(&rec);
+	if (par.json_name != NULL)
+		snap_close(&snap);
 	return 0;
 
-err_freq:
-	airspy_stop_rx(device);
+	// The files that already started are left to the exit.
 err_start:
-err_bias:
-err_packed:
-err_rate:
-err_sample:
-	airspy_close(device);
 err_open:
-	airspy_exit();
+	for (i = 0; i < par.nsrc; i++) {
+		if (srcv[i].device != NULL) {
+			airspy_stop_rx(srcv[i].device);
+			rx_pipe_stop(&srcv[i]);
+			airspy_close(srcv[i].device);
+		}
+	}
+	if (ndev != 0)
+		airspy_exit();
 err_init:
+	if (par.rec_name != NULL)
+		rec_close(&rec);
+	if (par.json_name != NULL)
+		snap_close(&snap);
 	return 1;
 }
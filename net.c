@@ -0,0 +1,406 @@
+/*
+ * The network output: one thread, one epoll, many clients
+ */
+
+#define _GNU_SOURCE	// accept4
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "net.h"
+#include "out.h"
+
+#define TAG "net"
+
+// What an epoll event is about: the kind in the top half, the index below.
+#define EV_EFD     0
+#define EV_LISTEN  1
+#define EV_CLIENT  2
+#define EV_TAG(kind, x)  ((uint32_t) (kind) << 16 | (x))
+
+#define NET_IOV    16
+
+static struct nbatch *batch_get(struct net *np)
+{
+	struct nbatch *b;
+
+	b = np->free;
+	if (b != NULL) {
+		np->free = b->next;
+	} else {
+		b = malloc(sizeof(struct nbatch));
+		if (b == NULL)
+			return NULL;
+	}
+	b->refs = 0;
+	b->len = 0;
+	return b;
+}
+
+static void batch_put(struct net *np, struct nbatch *b)
+{
+	if (b->refs != 0 && --b->refs != 0)
+		return;
+	b->next = np->free;
+	np->free = b;
+}
+
+static int ev_set(struct net *np, int op, int fd, uint32_t events,
+    uint32_t tag)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = events;
+	ev.data.u32 = tag;
+	return epoll_ctl(np->epfd, op, fd, &ev);
+}
+
+int net_init(struct net *np, int efd)
+{
+	int i;
+
+	memset(np, 0, sizeof(struct net));
+	for (i = 0; i < NET_CMAX; i++)
+		np->cv[i].fd = -1;
+	np->efd = efd;
+	np->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (np->epfd == -1) {
+		fprintf(stderr, TAG ": epoll_create1() failed: %s\n",
+		    strerror(errno));
+		return -1;
+	}
+	if (ev_set(np, EPOLL_CTL_ADD, efd, EPOLLIN, EV_TAG(EV_EFD, 0)) != 0) {
+		fprintf(stderr, TAG ": epoll_ctl() failed: %s\n",
+		    strerror(errno));
+		close(np->epfd);
+		return -1;
+	}
+	return 0;
+}
+
+int net_listen(struct net *np, enum out_fmt fmt, int port)
+{
+	struct nlisten *lp;
+	struct sockaddr_in sin;
+	int fd, on = 1;
+
+	if (np->nl == NET_LMAX) {
+		fprintf(stderr, TAG ": port %d: too many listeners\n", port);
+		return -1;
+	}
+	fd = socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		fprintf(stderr, TAG ": port %d: cannot make a socket: %s\n",
+		    port, strerror(errno));
+		goto err_socket;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin, 0, sizeof(struct sockaddr_in));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0 ||
+	    listen(fd, 16) != 0) {
+		fprintf(stderr, TAG ": port %d: cannot listen: %s\n",
+		    port, strerror(errno));
+		goto err_bind;
+	}
+	if (ev_set(np, EPOLL_CTL_ADD, fd, EPOLLIN,
+	    EV_TAG(EV_LISTEN, np->nl)) != 0) {
+		fprintf(stderr, TAG ": port %d: epoll_ctl() failed: %s\n",
+		    port, strerror(errno));
+		goto err_bind;
+	}
+
+	lp = &np->lv[np->nl++];
+	lp->fd = fd;
+	lp->fmt = fmt;
+	lp->nclients = 0;
+	lp->cur = NULL;
+	return 0;
+
+err_bind:
+	close(fd);
+err_socket:
+	return -1;
+}
+
+static void client_close(struct net *np, struct nclient *cp)
+{
+	epoll_ctl(np->epfd, EPOLL_CTL_DEL, cp->fd, NULL);
+	close(cp->fd);
+	cp->fd = -1;
+	while (cp->qn != 0) {
+		batch_put(np, cp->q[cp->qx]);
+		cp->qx = (cp->qx + 1) % NET_QLEN;
+		cp->qn--;
+	}
+	np->lv[cp->lx].nclients--;
+}
+
+/*
+ * Send what the socket takes without blocking, and ask the epoll for
+ * EPOLLOUT only while there's something left over.
+ */
+static void client_send(struct net *np, struct nclient *cp)
+{
+	struct iovec iov[NET_IOV];
+	struct msghdr msg;
+	struct nbatch *b;
+	unsigned int i, n, off;
+	ssize_t rc;
+
+	while (cp->qn != 0) {
+		off = cp->off;
+		n = (cp->qn < NET_IOV) ? cp->qn : NET_IOV;
+		for (i = 0; i < n; i++) {
+			b = cp->q[(cp->qx + i) % NET_QLEN];
+			iov[i].iov_base = b->buf + off;
+			iov[i].iov_len = b->len - off;
+			off = 0;
+		}
+		memset(&msg, 0, sizeof(struct msghdr));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
+		rc = sendmsg(cp->fd, &msg, MSG_NOSIGNAL|MSG_DONTWAIT);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			client_close(np, cp);
+			return;
+		}
+		np->st.bytes += rc;
+		cp->queued -= rc;
+		while (rc != 0) {
+			b = cp->q[cp->qx];
+			if (rc < b->len - cp->off) {
+				cp->off += rc;
+				break;
+			}
+			rc -= b->len - cp->off;
+			cp->off = 0;
+			batch_put(np, b);
+			cp->qx = (cp->qx + 1) % NET_QLEN;
+			cp->qn--;
+		}
+	}
+	if (cp->want_out != (cp->qn != 0)) {
+		cp->want_out = (cp->qn != 0);
+		ev_set(np, EPOLL_CTL_MOD, cp->fd,
+		    cp->want_out ? EPOLLIN|EPOLLOUT : EPOLLIN,
+		    EV_TAG(EV_CLIENT, cp - np->cv));
+	}
+}
+
+/*
+ * Queue the batch for the client. A client that lags gets the small
+ * batches merged into its last one, which it owns, and copies if shared.
+ * So two batches next to each other hold more than NET_BATCH, and the
+ * queue cannot fill up before NET_QMAX bytes do. Returns -1 if it does.
+ */
+static int client_queue(struct net *np, struct nclient *cp, struct nbatch *b)
+{
+	struct nbatch *t, *c;
+	unsigned int tx;
+
+	if (cp->qn != 0) {
+		tx = (cp->qx + cp->qn - 1) % NET_QLEN;
+		t = cp->q[tx];
+		if (t->len + b->len <= NET_BATCH) {
+			if (t->refs != 1 && (c = batch_get(np)) != NULL) {
+				memcpy(c->buf, t->buf, t->len);
+				c->len = t->len;
+				c->refs = 1;
+				batch_put(np, t);
+				cp->q[tx] = c;
+				t = c;
+			}
+			if (t->refs == 1) {
+				memcpy(t->buf + t->len, b->buf, b->len);
+				t->len += b->len;
+				cp->queued += b->len;
+				return 0;
+			}
+		}
+	}
+	if (cp->qn == NET_QLEN)
+		return -1;
+	cp->q[(cp->qx + cp->qn) % NET_QLEN] = b;
+	cp->qn++;
+	cp->queued += b->len;
+	b->refs++;
+	return 0;
+}
+
+/*
+ * Hand the batch being filled to every client of the listener.
+ */
+static void net_send_batch(struct net *np, int lx)
+{
+	struct nlisten *lp = &np->lv[lx];
+	struct nbatch *b = lp->cur;
+	struct nclient *cp;
+	int i;
+
+	lp->cur = NULL;
+	if (b == NULL)
+		return;
+	for (i = 0; i < NET_CMAX; i++) {
+		cp = &np->cv[i];
+		if (cp->fd == -1 || cp->lx != lx)
+			continue;
+		if (cp->queued + b->len > NET_QMAX ||
+		    client_queue(np, cp, b) != 0) {
+			np->st.slow++;
+			client_close(np, cp);
+		}
+	}
+	if (b->refs == 0)
+		batch_put(np, b);
+}
+
+/*
+ * Format the frame once for every listener that has clients.
+ * If there's no core for a batch, the frame is lost for the network.
+ */
+void net_frame(struct net *np, const struct ofr *fp)
+{
+	struct nlisten *lp;
+	int i;
+
+	for (i = 0; i < np->nl; i++) {
+		lp = &np->lv[i];
+		if (lp->nclients == 0)
+			continue;
+		if (lp->cur != NULL && lp->cur->len + OUT_REC > NET_BATCH)
+			net_send_batch(np, i);
+		if (lp->cur == NULL && (lp->cur = batch_get(np)) == NULL)
+			continue;
+		lp->cur->len += out_enc(lp->fmt, lp->cur->buf + lp->cur->len,
+		    fp);
+	}
+}
+
+void net_flush(struct net *np)
+{
+	int i;
+
+	for (i = 0; i < np->nl; i++) {
+		if (np->lv[i].cur != NULL)
+			net_send_batch(np, i);
+	}
+	for (i = 0; i < NET_CMAX; i++) {
+		if (np->cv[i].fd != -1 && np->cv[i].qn != 0)
+			client_send(np, &np->cv[i]);
+	}
+}
+
+static void net_accept(struct net *np, int lx)
+{
+	struct nclient *cp;
+	int sndbuf = NET_SNDBUF;
+	int fd, i;
+
+	while ((fd = accept4(np->lv[lx].fd, NULL, NULL,
+	    SOCK_NONBLOCK|SOCK_CLOEXEC)) != -1) {
+		for (i = 0; i < NET_CMAX; i++) {
+			if (np->cv[i].fd == -1)
+				break;
+		}
+		if (i == NET_CMAX ||
+		    ev_set(np, EPOLL_CTL_ADD, fd, EPOLLIN,
+		    EV_TAG(EV_CLIENT, i)) != 0) {
+			close(fd);
+			continue;
+		}
+		// Keep the kernel's share small, so that NET_QMAX is the bound.
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+		cp = &np->cv[i];
+		memset(cp, 0, sizeof(struct nclient));
+		cp->fd = fd;
+		cp->lx = lx;
+		np->lv[lx].nclients++;
+		np->st.accepts++;
+	}
+}
+
+/*
+ * Clients have nothing to tell us, so whatever they send is dropped.
+ * We only read to see them go away.
+ */
+static void client_read(struct net *np, struct nclient *cp)
+{
+	char buf[512];
+	ssize_t rc;
+
+	for (;;) {
+		rc = read(cp->fd, buf, sizeof(buf));
+		if (rc > 0)
+			continue;
+		if (rc < 0 && (errno == EINTR))
+			continue;
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		client_close(np, cp);
+		return;
+	}
+}
+
+/*
+ * Serve the network until the decoder kicks the eventfd.
+ */
+int net_wait(struct net *np)
+{
+	struct epoll_event evv[16];
+	struct nclient *cp;
+	eventfd_t cnt;
+	int kicked = 0;
+	int i, n;
+	uint32_t x;
+
+	while (!kicked) {
+		n = epoll_wait(np->epfd, evv, 16, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			x = evv[i].data.u32 & 0xFFFF;
+			switch (evv[i].data.u32 >> 16) {
+			case EV_EFD:
+				if (eventfd_read(np->efd, &cnt) != 0)
+					return -1;
+				kicked = 1;
+				break;
+			case EV_LISTEN:
+				net_accept(np, x);
+				break;
+			default:
+				cp = &np->cv[x];
+				if (cp->fd == -1)
+					break;
+				if (evv[i].events & (EPOLLERR|EPOLLHUP)) {
+					client_close(np, cp);
+					break;
+				}
+				if (evv[i].events & EPOLLIN)
+					client_read(np, cp);
+				if (cp->fd != -1 && (evv[i].events & EPOLLOUT))
+					client_send(np, cp);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * The network output: one thread, one epoll, many clients
+ *
+ * Every listener has a format. Frames are formatted once per format into
+ * a batch, and the batch is shared by reference between all clients of
+ * that format. A client that falls behind by more than NET_QMAX bytes is
+ * cut off, so the decoder never waits for the network. The epoll also
+ * watches the eventfd of the decoder, so the main loop sleeps in one place.
+ */
+
+#include "out.h"
+
+#define NET_LMAX   4		// listeners
+#define NET_CMAX   64		// clients of all listeners
+#define NET_BATCH  (64*1024)	// a batch of formatted frames
+#define NET_QLEN   64		// batches queued for one client, > 2*QMAX/BATCH
+#define NET_QMAX   (1024*1024)	// bytes queued for one client
+#define NET_SNDBUF (64*1024)	// the socket's own buffer
+
+struct nbatch {
+	struct nbatch *next;	// in the free list
+	unsigned int refs;
+	unsigned int len;
+	unsigned char buf[NET_BATCH];
+};
+
+struct nlisten {
+	int fd;
+	enum out_fmt fmt;
+	unsigned int nclients;
+	struct nbatch *cur;	// being filled
+};
+
+struct nclient {
+	int fd;			// -1 if the slot is free
+	int lx;			// the listener
+	unsigned int qx, qn;	// the queue of batches, ring by qx
+	unsigned int off;	// sent of the batch at qx
+	unsigned long queued;	// bytes not sent yet
+	int want_out;		// EPOLLOUT is on
+	struct nbatch *q[NET_QLEN];
+};
+
+struct net_stats {
+	unsigned long accepts;
+	unsigned long slow;	// clients cut for falling behind
+	unsigned long bytes;
+};
+
+struct net {
+	int epfd;
+	int efd;		// the decoder's eventfd
+	int nl;
+	struct nlisten lv[NET_LMAX];
+	struct nclient cv[NET_CMAX];
+	struct nbatch *free;
+	struct net_stats st;
+};
+
+int net_init(struct net *np, int efd);
+int net_listen(struct net *np, enum out_fmt fmt, int port);
+void net_frame(struct net *np, const struct ofr *fp);
+void net_flush(struct net *np);
+int net_wait(struct net *np);
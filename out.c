@@ -0,0 +1,260 @@
+/*
+ * The output of frames
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "air.h"
+#include "crc.h"
+#include "out.h"
+
+#define BEAST_ESC  0x1a
+
+const char out_hex[] = "0123456789abcdef";
+
+void out_init(struct out *op, int fd, enum out_fmt fmt)
+{
+	op->fd = fd;
+	op->fmt = fmt;
+	op->err = 0;
+	op->len = 0;
+}
+
+/*
+ * The AVR is "*" or "@" with 12 hex digits of the 12 MHz clock,
+ * then the frame in hex, then ";" and a newline.
+ */
+static unsigned char *out_avr(unsigned char *p, enum out_fmt fmt,
+    const unsigned char *pkt, unsigned int plen, uint64_t ts)
+{
+	unsigned int i;
+
+	if (fmt == OUT_AVR_T) {
+		*p++ = '@';
+		for (i = 0; i < 12; i++)
+			*p++ = out_hex[(ts >> (44 - i*4)) & 0xF];
+	} else {
+		*p++ = '*';
+	}
+	for (i = 0; i < plen; i++) {
+		*p++ = out_hex[pkt[i] >> 4];
+		*p++ = out_hex[pkt[i] & 0xF];
+	}
+	*p++ = ';';
+	*p++ = '\n';
+	return p;
+}
+
+/*
+ * The Beast is the escape, the type '2' for 56 bits or '3' for 112,
+ * 6 bytes of the 12 MHz clock and 1 byte of the signal, all big-endian,
+ * then the frame. Every escape after the type is doubled.
+ * The source goes first, as the type 0xe3 with 8 bytes of the id.
+ */
+static unsigned char *out_beast(unsigned char *p,
+    const unsigned char *pkt, unsigned int plen, uint64_t ts,
+    unsigned int rssi, unsigned int src)
+{
+	unsigned char hdr[7];
+	unsigned int i;
+
+	if (src != 0) {
+		*p++ = BEAST_ESC;
+		*p++ = 0xe3;
+		for (i = 0; i < 8; i++) {
+			if ((*p++ = (uint64_t) src >> (56 - i*8)) == BEAST_ESC)
+				*p++ = BEAST_ESC;
+		}
+	}
+
+	for (i = 0; i < 6; i++)
+		hdr[i] = ts >> (40 - i*8);
+	hdr[6] = rssi;
+
+	*p++ = BEAST_ESC;
+	*p++ = (plen == 7) ? '2' : '3';
+	for (i = 0; i < 7; i++) {
+		if ((*p++ = hdr[i]) == BEAST_ESC)
+			*p++ = BEAST_ESC;
+	}
+	for (i = 0; i < plen; i++) {
+		if ((*p++ = pkt[i]) == BEAST_ESC)
+			*p++ = BEAST_ESC;
+	}
+	return p;
+}
+
+/*
+ * The SBS has no place for the raw frame, only for what it means, so
+ * each frame becomes one MSG line with the fields that it gives: the
+ * identification or the altitude from the ADS-B, the altitude or the
+ * squawk from the replies, and the address from everything. If the frame
+ * updated an aircraft, the position or the velocity come from there.
+ */
+static unsigned int out_sbs(unsigned char *p, const struct ofr *fp)
+{
+	const unsigned char *pkt = fp->pkt;
+	unsigned int df = pkt[0] >> 3;
+	unsigned int addr, tc;
+	const struct aircraft *ap = fp->ap;
+	char call[9];
+	char alt[12], sq[8], pos[40], vel[24], vr[12];
+	int type, a;
+	struct tm tm;
+	time_t sec;
+	unsigned int ms;
+
+	call[0] = 0;
+	alt[0] = 0;
+	sq[0] = 0;
+	strcpy(pos, ",");
+	strcpy(vel, ",");
+	vr[0] = 0;
+	if (df == 11 || df == 17 || df == 18) {
+		addr = pkt[1] << 16 | pkt[2] << 8 | pkt[3];
+		type = 8;
+	} else {
+		addr = crc_syndrome(pkt, fp->plen);
+		type = (df == 0 || df == 4 || df == 20) ? 5 : 6;
+		if (df == 0 || df == 4 || df == 16 || df == 20) {
+			a = ac13_alt((pkt[2] & 0x1F) << 8 | pkt[3]);
+			if (a != AIR_NONE)
+				snprintf(alt, sizeof(alt), "%d", a);
+		} else if (df == 5 || df == 21) {
+			snprintf(sq, sizeof(sq), "%04u",
+			    id13_squawk((pkt[2] & 0x1F) << 8 | pkt[3]));
+		}
+		if (df == 0 || df == 16)
+			type = 7;
+	}
+	if (air_es(pkt, fp->plen)) {
+		tc = pkt[4] >> 3;
+		if (tc >= 1 && tc <= 4) {
+			ais_call(pkt + 4, call);
+			type = 1;
+		} else if ((tc >= 9 && tc <= 18) || (tc >= 20 && tc <= 22)) {
+			a = ac12_alt(pkt[5] << 4 | pkt[6] >> 4);
+			if (tc <= 18 && a != AIR_NONE)
+				snprintf(alt, sizeof(alt), "%d", a);
+			if (ap != NULL && ap->pos_seen == ap->seen) {
+				snprintf(pos, sizeof(pos), "%.5f,%.5f",
+				    ap->lat * (360.0 / 4294967296.0),
+				    ap->lon * (360.0 / 4294967296.0));
+			}
+			type = 3;
+		} else if (tc == 19 && ap != NULL) {
+			if (ap->gs != AIR_NONE && ap->track != AIR_NONE)
+				snprintf(vel, sizeof(vel), "%d,%.1f",
+				    ap->gs, ap->track / 100.0);
+			if (ap->vr != AIR_NONE)
+				snprintf(vr, sizeof(vr), "%d", ap->vr);
+			type = 4;
+		}
+	}
+
+	sec = fp->rt / 1000000000;
+	ms = (fp->rt / 1000000) % 1000;
+	gmtime_r(&sec, &tm);
+	return snprintf((char *) p, OUT_REC,
+	    "MSG,%d,%u,1,%06X,1,%04d/%02d/%02d,%02d:%02d:%02d.%03u,"
+	    "%04d/%02d/%02d,%02d:%02d:%02d.%03u,%s,%s,%s,%s,%s,%s,,,,\r\n",
+	    type, fp->src ? fp->src : 1, addr,
+	    tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+	    tm.tm_hour, tm.tm_min, tm.tm_sec, ms,
+	    tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+	    tm.tm_hour, tm.tm_min, tm.tm_sec, ms,
+	    call, alt, vel, pos, vr, sq);
+}
+
+/*
+ * The RSSI of the Beast is the amplitude, 255 at the full scale.
+ */
+unsigned int out_rssi(int level)
+{
+	unsigned int v;
+
+	v = (level * 255) / 2047;
+	return (v > 255) ? 255 : v;
+}
+
+int out_fmt_find(const char *name, enum out_fmt *fmtp)
+{
+	if (strcmp(name, "avr") == 0)
+		*fmtp = OUT_AVR;
+	else if (strcmp(name, "avrt") == 0)
+		*fmtp = OUT_AVR_T;
+	else if (strcmp(name, "beast") == 0)
+		*fmtp = OUT_BEAST;
+	else if (strcmp(name, "sbs") == 0)
+		*fmtp = OUT_SBS;
+	else
+		return -1;
+	return 0;
+}
+
+/*
+ * Format one frame at p, which has room for OUT_REC bytes.
+ * Return the length.
+ */
+unsigned int out_enc(enum out_fmt fmt, unsigned char *p,
+    const struct ofr *fp)
+{
+	switch (fmt) {
+	case OUT_BEAST:
+		return out_beast(p, fp->pkt, fp->plen, fp->ts, fp->rssi,
+		    fp->src) - p;
+	case OUT_SBS:
+		return out_sbs(p, fp);
+	default:
+		return out_avr(p, fmt, fp->pkt, fp->plen, fp->ts) - p;
+	}
+}
+
+void out_frame(struct out *op, const struct ofr *fp)
+{
+	if (op->len + OUT_REC > OUT_BUFSZ)
+		out_flush(op);
+	op->len += out_enc(op->fmt, op->buf + op->len, fp);
+}
+
+/*
+ * Lines of text that go between the frames, such as the statistics.
+ * A line longer than the whole buffer is cut.
+ */
+void out_text(struct out *op, const char *s, unsigned int n)
+{
+	if (op->len + n > OUT_BUFSZ)
+		out_flush(op);
+	if (n > OUT_BUFSZ)
+		n = OUT_BUFSZ;
+	memcpy(op->buf + op->len, s, n);
+	op->len += n;
+}
+
+/*
+ * Write out the buffer. The buffer is emptied even on an error, and the
+ * error sticks, so that a flush forced by a full buffer is not lost.
+ */
+int out_flush(struct out *op)
+{
+	const unsigned char *p = op->buf;
+	unsigned int n = op->len;
+	ssize_t rc;
+
+	op->len = 0;
+	while (n != 0 && op->err == 0) {
+		rc = write(op->fd, p, n);
+		if (rc < 0) {
+			if (errno != EINTR)
+				op->err = errno;
+			continue;
+		}
+		p += rc;
+		n -= rc;
+	}
+	return (op->err != 0) ? -1 : 0;
+}
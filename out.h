@@ -0,0 +1,59 @@
+/*
+ * The output of frames
+ *
+ * Frames are formatted into one buffer, which goes out with a single
+ * write() when the main loop has drained what the decoder gave it, or
+ * sooner if the buffer fills up. The formats are the AVR text, with or
+ * without the MLAT timestamp, the Beast binary, and the SBS (BaseStation)
+ * text with whatever one frame tells about the aircraft.
+ *
+ * With several sources, the Beast frames carry the source in a receiver
+ * id before them, as readsb does, and the SBS in the session id.
+ * The AVR has no place for it.
+ *
+ * The network output embeds the formats, so this may be included more
+ * than once.
+ */
+
+#ifndef OUT_H
+#define OUT_H
+
+#include <stdint.h>
+
+#define OUT_BUFSZ  (128*1024)
+#define OUT_REC    256		// the longest record of any format
+
+enum out_fmt { OUT_AVR, OUT_AVR_T, OUT_BEAST, OUT_SBS };
+
+struct aircraft;
+
+struct ofr {
+	const unsigned char *pkt;
+	unsigned int plen;
+	uint64_t ts;		// the 12 MHz clock, 48 bits
+	unsigned int rssi;	// 0..255
+	uint64_t rt;		// CLOCK_REALTIME in ns, for the SBS
+	const struct aircraft *ap;	// that the frame updated, or NULL
+	unsigned int src;	// the source, 0 if there's only one
+};
+
+struct out {
+	int fd;
+	enum out_fmt fmt;
+	int err;		// errno of the first failed write, or 0
+	unsigned int len;
+	unsigned char buf[OUT_BUFSZ];
+};
+
+extern const char out_hex[];	// the digits, for the snapshot too
+
+unsigned int out_rssi(int level);
+int out_fmt_find(const char *name, enum out_fmt *fmtp);
+unsigned int out_enc(enum out_fmt fmt, unsigned char *p,
+    const struct ofr *fp);
+void out_init(struct out *op, int fd, enum out_fmt fmt);
+void out_frame(struct out *op, const struct ofr *fp);
+void out_text(struct out *op, const char *s, unsigned int n);
+int out_flush(struct out *op);
+
+#endif
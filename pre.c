@@ -10,6 +10,11 @@
 #include <string.h>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "icao.h"
 #include "upd.h"
 #include "yoga.h"
 
@@ -25,8 +30,10 @@ static const int pfun[APP] = {
 };
 
 // p: the non-negative averaged 'p' value
+// nt: the number of tracks, a constant in every instance
 // return: the correlation (boolean for match)
-int preamble_match(struct rstate *rs, int p)
+static inline __attribute__((always_inline))
+int preamble_match_t(struct rstate *rs, int p, const int nt)
 {
 	struct track *tp;
 	int sub, avg_p, thr_0, thr_1;
@@ -44,7 +51,7 @@ int preamble_match(struct rstate *rs, int p)
 	tx_saved = rs->tx;
 #endif
 	tp = &rs->tvec[rs->tx];
-	rs->tx = (rs->tx + 1) % NT;
+	rs->tx = (rs->tx + 1) % nt;
 
 	sub = tp->t_p[tp->t_x];
 	tp->t_p[tp->t_x] = p;
@@ -106,3 +113,250 @@ int preamble_match(struct rstate *rs, int p)
 
 	return cor;
 }
+
+/*
+ * The bitmask correlator. It builds two bit-planes of the window: which
+ * p are at or above thr_1, and which are below thr_0. The bits are in
+ * the order of the ring, so there's no modulo, and the loop has no
+ * branches. A match is then two ANDs against pfun[] as masks, rotated
+ * to where the oldest sample sits in the ring.
+ *
+ * The planes cannot be kept across calls and shifted, because every
+ * new sample moves the thresholds for the whole window.
+ */
+#define PF_ALL    ((1 << APP) - 1)
+#define PF_ONE    (1<<0 | 1<<2 | 1<<7 | 1<<9)	// pfun[], the oldest in bit 0
+#define PF_ZERO   (~PF_ONE & PF_ALL)
+
+static inline unsigned int pf_rot(unsigned int m, unsigned int x)
+{
+	return ((m << x) | (m >> (APP - x))) & PF_ALL;
+}
+
+static inline __attribute__((always_inline))
+int preamble_mask_t(struct rstate *rs, int p, const int nt)
+{
+	struct track *tp;
+	int sub, avg_p, thr_0, thr_1;
+	unsigned int hi, lo, one, zero;
+#ifndef __SSE2__
+	int i;
+#endif
+
+	tp = &rs->tvec[rs->tx];
+	rs->tx = (rs->tx + 1) % nt;
+
+	sub = tp->t_p[tp->t_x];
+	tp->t_p[tp->t_x] = p;
+	tp->t_x = (tp->t_x + 1) % APP;
+	AVG_UPD_P(&tp->ap_u, sub, p);
+	avg_p = tp->ap_u / APP;
+
+	thr_0 = (avg_p*8)/5;	// 40%, as above
+	thr_1 = (avg_p*10)/5;	// 50%
+
+	/*
+	 * Most of the time, the oldest sample is not a pulse, and the ring
+	 * walk above quits on the first step. Do the same.
+	 */
+	if (tp->t_p[tp->t_x] < thr_1)
+		return 0;
+
+#ifdef __SSE2__
+	{
+		__m128i v0, v1, v2, v3, t1, t0;
+
+		v0 = _mm_loadu_si128((const __m128i *) &tp->t_p[0]);
+		v1 = _mm_loadu_si128((const __m128i *) &tp->t_p[4]);
+		v2 = _mm_loadu_si128((const __m128i *) &tp->t_p[8]);
+		v3 = _mm_loadu_si128((const __m128i *) &tp->t_p[12]);
+		t1 = _mm_set1_epi32(thr_1 - 1);
+		t0 = _mm_set1_epi32(thr_0);
+		hi = _mm_movemask_epi8(_mm_packs_epi16(
+		    _mm_packs_epi32(_mm_cmpgt_epi32(v0, t1),
+		      _mm_cmpgt_epi32(v1, t1)),
+		    _mm_packs_epi32(_mm_cmpgt_epi32(v2, t1),
+		      _mm_cmpgt_epi32(v3, t1))));
+		lo = _mm_movemask_epi8(_mm_packs_epi16(
+		    _mm_packs_epi32(_mm_cmpgt_epi32(t0, v0),
+		      _mm_cmpgt_epi32(t0, v1)),
+		    _mm_packs_epi32(_mm_cmpgt_epi32(t0, v2),
+		      _mm_cmpgt_epi32(t0, v3))));
+	}
+#else
+	hi = 0;
+	lo = 0;
+	for (i = 0; i < APP; i++) {
+		hi |= (tp->t_p[i] >= thr_1) << i;
+		lo |= (tp->t_p[i] < thr_0) << i;
+	}
+#endif
+
+	// The oldest sample is where the next one goes.
+	one = pf_rot(PF_ONE, tp->t_x);
+	zero = pf_rot(PF_ZERO, tp->t_x);
+	return ((one & ~hi) | (zero & ~lo)) == 0;
+}
+
+int preamble_match_2(struct rstate *rs, int p)
+{
+	return preamble_match_t(rs, p, 2);
+}
+
+int preamble_match_5(struct rstate *rs, int p)
+{
+	return preamble_match_t(rs, p, 5);
+}
+
+int preamble_mask_2(struct rstate *rs, int p)
+{
+	return preamble_mask_t(rs, p, 2);
+}
+
+int preamble_mask_5(struct rstate *rs, int p)
+{
+	return preamble_mask_t(rs, p, 5);
+}
+
+/*
+ * The full-rate correlator. Instead of probing every df samples with a
+ * few tracks, test the window that ends at every sample of the block,
+ * so every phase of the half-bit gets its chance. The test is the same
+ * as above, with the window read straight from the smoothed magnitudes,
+ * h samples apart. The history of (APP-1)*h samples must precede pv[0].
+ *
+ * A match gets a score: the pulses against the quiet half-bits, three
+ * to one, since there are four pulses and twelve quiet half-bits. The
+ * neighbouring phases match too, the caller picks the best one of them.
+ * The magnitudes are at most 2048, so all of this fits into 16 bits.
+ */
+static inline __attribute__((always_inline))
+int pre_score1(const int16_t *pv, const int h)
+{
+	int w[APP];
+	int sum, ones, thr_0, thr_1;
+	int k;
+
+	sum = 0;
+	for (k = 0; k < APP; k++) {
+		w[k] = pv[-(APP-1-k)*h];
+		sum += w[k];
+	}
+	ones = w[0] + w[2] + w[7] + w[9];	// pfun[]
+	thr_0 = ((sum/APP)*8)/5;
+	thr_1 = ((sum/APP)*10)/5;
+	for (k = 0; k < APP; k++) {
+		if ((PF_ONE >> k) & 1) {
+			if (w[k] < thr_1)
+				return PRE_NONE;
+		} else {
+			if (w[k] >= thr_0)
+				return PRE_NONE;
+		}
+	}
+	return 4*ones - sum;
+}
+
+#ifdef __SSE2__
+/*
+ * Eight positions at once. The sum of 16 magnitudes may reach 32768,
+ * which is fine as unsigned, and the score fits as signed.
+ *
+ * Every pulse must be above each of its quiet neighbours, whatever the
+ * average is. In noise, this fails for all eight positions most of the
+ * time, and then we skip the rest.
+ */
+#define W(k)  _mm_loadu_si128((const __m128i *) (pv + i - (APP-1-(k))*h))
+
+static inline __attribute__((always_inline))
+void pre_scan_t(const int16_t *pv, int16_t *score, unsigned int n,
+    const int h)
+{
+	__m128i w, sum, ones, lo1, hi0, avg, thr_0, thr_1, ok, sc;
+	__m128i five = _mm_set1_epi16(0xCCCD);	// x/5 == x*0xCCCD >> 18
+	__m128i none = _mm_set1_epi16(PRE_NONE);
+	unsigned int i;
+	int k;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		ok = _mm_and_si128(
+		    _mm_and_si128(_mm_cmpgt_epi16(W(0), W(1)),
+		      _mm_cmpgt_epi16(W(2), W(1))),
+		    _mm_and_si128(_mm_cmpgt_epi16(W(2), W(3)),
+		      _mm_cmpgt_epi16(W(7), W(6))));
+		ok = _mm_and_si128(ok,
+		    _mm_and_si128(_mm_cmpgt_epi16(W(7), W(8)),
+		      _mm_cmpgt_epi16(W(9), W(10))));
+		if (_mm_movemask_epi8(ok) == 0) {
+			_mm_storeu_si128((__m128i *) (score + i), none);
+			continue;
+		}
+
+		sum = _mm_setzero_si128();
+		ones = _mm_setzero_si128();
+		lo1 = _mm_set1_epi16(0x7FFF);	// the lowest pulse
+		hi0 = _mm_setzero_si128();	// the highest quiet half-bit
+		for (k = 0; k < APP; k++) {
+			w = W(k);
+			sum = _mm_add_epi16(sum, w);
+			if ((PF_ONE >> k) & 1) {
+				ones = _mm_add_epi16(ones, w);
+				lo1 = _mm_min_epi16(lo1, w);
+			} else {
+				hi0 = _mm_max_epi16(hi0, w);
+			}
+		}
+		avg = _mm_srli_epi16(sum, 4);
+		thr_0 = _mm_srli_epi16(_mm_mulhi_epu16(_mm_slli_epi16(avg, 3),
+		    five), 2);
+		thr_1 = _mm_sub_epi16(_mm_slli_epi16(avg, 1),
+		    _mm_set1_epi16(1));
+		ok = _mm_and_si128(_mm_cmpgt_epi16(lo1, thr_1),
+		    _mm_cmpgt_epi16(thr_0, hi0));
+
+		sc = _mm_sub_epi16(_mm_slli_epi16(ones, 2), sum);
+		sc = _mm_or_si128(_mm_and_si128(ok, sc),
+		    _mm_andnot_si128(ok, none));
+		_mm_storeu_si128((__m128i *) (score + i), sc);
+	}
+	for (; i < n; i++)
+		score[i] = pre_score1(pv + i, h);
+}
+
+#undef W
+#else
+static inline __attribute__((always_inline))
+void pre_scan_t(const int16_t *pv, int16_t *score, unsigned int n,
+    const int h)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		score[i] = pre_score1(pv + i, h);
+}
+#endif
+
+void pre_scan_10(const int16_t *pv, int16_t *score, unsigned int n)
+{
+	pre_scan_t(pv, score, n, 10);
+}
+
+void pre_scan_6(const int16_t *pv, int16_t *score, unsigned int n)
+{
+	pre_scan_t(pv, score, n, 6);
+}
+
+void pre_scan_5(const int16_t *pv, int16_t *score, unsigned int n)
+{
+	pre_scan_t(pv, score, n, 5);
+}
+
+/*
+ * For those who do not care for speed, such as the capture mode.
+ */
+int preamble_match(struct rstate *rs, int p)
+{
+	if (rs->pre_match == NULL)
+		return (*rs->var->pre_mask)(rs, p);
+	return (*rs->pre_match)(rs, p);
+}
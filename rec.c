@@ -0,0 +1,269 @@
+/*
+ * The recorder: a writer thread that puts raw transfers on disk
+ */
+
+#define _GNU_SOURCE	// O_DIRECT
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "rec.h"
+
+static unsigned char *rec_buf(struct rec *rp, unsigned int x)
+{
+	return rp->pool + (size_t)x * REC_BUFSZ;
+}
+
+static void rec_inc(atomic_ulong *p)
+{
+
+	atomic_store_explicit(p, atomic_load_explicit(p, memory_order_relaxed)
+	    + 1, memory_order_relaxed);
+}
+
+static int rec_write(struct rec *rp, const unsigned char *buf,
+    unsigned int len)
+{
+	ssize_t rc;
+
+	while (len != 0) {
+		rc = write(rp->fd, buf, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+/*
+ * Wait for the next full buffer, or return -1 once closed and drained.
+ */
+static int rec_next(struct rec *rp)
+{
+	eventfd_t v;
+	int x;
+
+	for (;;) {
+		x = ring_get_begin(&rp->full_ring);
+		if (x != -1)
+			return x;
+		if (atomic_load_explicit(&rp->closing, memory_order_acquire)) {
+			// A buffer may have come in just before the close.
+			return ring_get_begin(&rp->full_ring);
+		}
+		eventfd_read(rp->efd, &v);
+	}
+}
+
+static void *rec_thread(void *arg)
+{
+	struct rec *rp = arg;
+	struct timespec t0, t1;
+	unsigned int x, len;
+	int error = 0;
+	long ms;
+	int fx;
+
+	while ((fx = rec_next(rp)) != -1) {
+		x = rp->full_vec[fx];
+		ring_get_end(&rp->full_ring);
+		len = rp->blen[x];
+
+		/*
+		 * The last buffer is short and cannot go through O_DIRECT.
+		 * It only comes at the very end, so just drop the flag.
+		 */
+		if (rp->direct && len % 4096 != 0) {
+			fcntl(rp->fd, F_SETFL,
+			    fcntl(rp->fd, F_GETFL) & ~O_DIRECT);
+			rp->direct = 0;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (!error && rec_write(rp, rec_buf(rp, x), len) != 0) {
+			fprintf(stderr, "%s: write error: %s\n",
+			    rp->name, strerror(errno));
+			error = 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ms = (t1.tv_sec - t0.tv_sec) * 1000 +
+		    (t1.tv_nsec - t0.tv_nsec) / 1000000;
+
+		if (!error) {
+			atomic_store_explicit(&rp->bytes,
+			    atomic_load_explicit(&rp->bytes,
+			    memory_order_relaxed) + len, memory_order_relaxed);
+		}
+		if (ms >= REC_STALL_MS)
+			rec_inc(&rp->stalls);
+
+		// Never full, there are only as many buffers as slots.
+		fx = ring_put_begin(&rp->free_ring);
+		rp->free_vec[fx] = x;
+		ring_put_end(&rp->free_ring);
+	}
+	return NULL;
+}
+
+int rec_open(struct rec *rp, const char *name)
+{
+	void *p;
+	int i;
+	int rc;
+
+	memset(rp, 0, sizeof(struct rec));
+	rp->name = name;
+	rp->cur = -1;
+	ring_init(&rp->free_ring, REC_NBUF);
+	ring_init(&rp->full_ring, REC_NBUF);
+	atomic_init(&rp->closing, 0);
+	atomic_init(&rp->bytes, 0);
+	atomic_init(&rp->stalls, 0);
+	atomic_init(&rp->drops, 0);
+
+	rp->direct = 1;
+	rp->fd = open(name, O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT, 0666);
+	if (rp->fd == -1 && errno == EINVAL) {
+		// Some filesystems, such as tmpfs, refuse O_DIRECT.
+		rp->direct = 0;
+		rp->fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	}
+	if (rp->fd == -1) {
+		fprintf(stderr, "%s: cannot open: %s\n",
+		    name, strerror(errno));
+		goto err_open;
+	}
+
+	rp->efd = eventfd(0, 0);
+	if (rp->efd == -1) {
+		fprintf(stderr, "%s: eventfd() failed: %s\n",
+		    name, strerror(errno));
+		goto err_efd;
+	}
+
+	if (posix_memalign(&p, 4096, (size_t)REC_NBUF * REC_BUFSZ) != 0) {
+		fprintf(stderr, "%s: no core for buffers\n", name);
+		goto err_pool;
+	}
+	rp->pool = p;
+	// Touch the pool now, so the callback does not take page faults.
+	memset(rp->pool, 0, (size_t)REC_NBUF * REC_BUFSZ);
+	for (i = 0; i < REC_NBUF; i++) {
+		rp->free_vec[ring_put_begin(&rp->free_ring)] = i;
+		ring_put_end(&rp->free_ring);
+	}
+
+	rc = pthread_create(&rp->thread, NULL, rec_thread, rp);
+	if (rc != 0) {
+		fprintf(stderr, "%s: pthread_create() failed: %d\n",
+		    name, rc);
+		goto err_thread;
+	}
+	return 0;
+
+err_thread:
+	free(rp->pool);
+err_pool:
+	close(rp->efd);
+err_efd:
+	close(rp->fd);
+err_open:
+	return -1;
+}
+
+/*
+ * Only call this from one thread, the receiving one.
+ * A transfer is either recorded in full or dropped in full.
+ */
+void rec_put(struct rec *rp, const void *data, unsigned int len)
+{
+	const unsigned char *sp = data;
+	unsigned int room, n, need;
+	int x;
+
+	room = (rp->cur == -1) ? 0 : REC_BUFSZ - rp->blen[rp->cur];
+	if (len > room) {
+		// We are the only taker, so the free count can only grow.
+		need = (len - room + REC_BUFSZ - 1) / REC_BUFSZ;
+		if (ring_count(&rp->free_ring) < need) {
+			rec_inc(&rp->drops);
+			return;
+		}
+	}
+
+	while (len != 0) {
+		if (rp->cur == -1) {
+			x = ring_get_begin(&rp->free_ring);
+			rp->cur = rp->free_vec[x];
+			ring_get_end(&rp->free_ring);
+			rp->blen[rp->cur] = 0;
+		}
+
+		n = REC_BUFSZ - rp->blen[rp->cur];
+		if (n > len)
+			n = len;
+		memcpy(rec_buf(rp, rp->cur) + rp->blen[rp->cur], sp, n);
+		rp->blen[rp->cur] += n;
+		sp += n;
+		len -= n;
+
+		if (rp->blen[rp->cur] == REC_BUFSZ) {
+			x = ring_put_begin(&rp->full_ring);
+			rp->full_vec[x] = rp->cur;
+			ring_put_end(&rp->full_ring);
+			eventfd_write(rp->efd, 1);
+			rp->cur = -1;
+		}
+	}
+}
+
+/*
+ * Fetch the counts accumulated since the previous call.
+ * Only call this from one thread.
+ */
+void rec_stats(struct rec *rp, struct rec_stats *sp)
+{
+	struct rec_stats now;
+
+	now.bytes = atomic_load_explicit(&rp->bytes, memory_order_relaxed);
+	now.stalls = atomic_load_explicit(&rp->stalls, memory_order_relaxed);
+	now.drops = atomic_load_explicit(&rp->drops, memory_order_relaxed);
+	sp->bytes = now.bytes - rp->last.bytes;
+	sp->stalls = now.stalls - rp->last.stalls;
+	sp->drops = now.drops - rp->last.drops;
+	rp->last = now;
+}
+
+/*
+ * The receiving must be stopped by the time this is called.
+ */
+void rec_close(struct rec *rp)
+{
+	int x;
+
+	if (rp->cur != -1 && rp->blen[rp->cur] != 0) {
+		x = ring_put_begin(&rp->full_ring);
+		rp->full_vec[x] = rp->cur;
+		ring_put_end(&rp->full_ring);
+	}
+	rp->cur = -1;
+	atomic_store_explicit(&rp->closing, 1, memory_order_release);
+	eventfd_write(rp->efd, 1);
+
+	pthread_join(rp->thread, NULL);
+	close(rp->efd);
+	close(rp->fd);
+	free(rp->pool);
+	rp->pool = NULL;
+}
@@ -0,0 +1,52 @@
+/*
+ * The recorder: a writer thread that puts raw transfers on disk
+ *
+ * The receiving thread only copies into a preallocated buffer. Full buffers
+ * are handed to the writer thread, so the USB callback never waits for
+ * the filesystem. If the writer falls behind, whole transfers are dropped.
+ * The buffers go back and forth over a pair of rings, so the receiving
+ * side takes no locks, and only kicks the writer through an eventfd.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ring.h"
+
+// The buffers are page-aligned and a multiple of the page, for O_DIRECT.
+#define REC_BUFSZ  (1024*1024)
+#define REC_NBUF   32		// a power of 2, for the rings
+
+// A write that takes longer than this is counted as a stall.
+#define REC_STALL_MS  100
+
+struct rec_stats {
+	unsigned long long bytes;
+	unsigned long stalls;
+	unsigned long drops;	// in transfers
+};
+
+struct rec {
+	const char *name;
+	int fd;
+	int direct;
+	int efd;		// kicked once per full buffer
+	pthread_t thread;
+	unsigned char *pool;
+	unsigned int blen[REC_NBUF];
+	struct ring free_ring;	// the writer puts, the receiver gets
+	unsigned int free_vec[REC_NBUF];
+	struct ring full_ring;	// the receiver puts, the writer gets
+	unsigned int full_vec[REC_NBUF];
+	atomic_int closing;
+	int cur;		// buffer being filled, -1 if none
+	// The counts since the start, each has one writer.
+	atomic_ullong bytes;
+	atomic_ulong stalls, drops;
+	struct rec_stats last;	// for the caller of rec_stats()
+};
+
+int rec_open(struct rec *rp, const char *name);
+void rec_put(struct rec *rp, const void *data, unsigned int len);
+void rec_stats(struct rec *rp, struct rec_stats *sp);
+void rec_close(struct rec *rp);
@@ -0,0 +1,89 @@
+/*
+ * A single-producer, single-consumer ring
+ *
+ * The ring only hands out positions. The user keeps a vector of slots
+ * of the same size and fills or drains the slot between _begin and _end.
+ * No locks, no allocations, and no RMW atomics: each index has one writer.
+ *
+ * Other headers embed the ring, so this one may be included more than once.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+
+#define RING_CLSZ  64
+
+struct ring {
+	_Alignas(RING_CLSZ) atomic_uint head;	// the producer writes
+	unsigned int tail_seen;			// producer's copy of tail
+	_Alignas(RING_CLSZ) atomic_uint tail;	// the consumer writes
+	unsigned int head_seen;			// consumer's copy of head
+	_Alignas(RING_CLSZ) unsigned int mask;
+};
+
+// The size must be a power of 2.
+static inline void ring_init(struct ring *r, unsigned int size)
+{
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	r->tail_seen = 0;
+	r->head_seen = 0;
+	r->mask = size - 1;
+}
+
+// Producer: return the slot to fill, or -1 if the ring is full.
+static inline int ring_put_begin(struct ring *r)
+{
+	unsigned int h;
+
+	h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	if (h - r->tail_seen > r->mask) {
+		r->tail_seen = atomic_load_explicit(&r->tail,
+		    memory_order_acquire);
+		if (h - r->tail_seen > r->mask)
+			return -1;
+	}
+	return h & r->mask;
+}
+
+static inline void ring_put_end(struct ring *r)
+{
+	unsigned int h;
+
+	h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+// Consumer: return the slot to drain, or -1 if the ring is empty.
+static inline int ring_get_begin(struct ring *r)
+{
+	unsigned int t;
+
+	t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	if (t == r->head_seen) {
+		r->head_seen = atomic_load_explicit(&r->head,
+		    memory_order_acquire);
+		if (t == r->head_seen)
+			return -1;
+	}
+	return t & r->mask;
+}
+
+static inline void ring_get_end(struct ring *r)
+{
+	unsigned int t;
+
+	t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+}
+
+// Any thread: a snapshot of the occupancy, stale by the time it's used.
+static inline unsigned int ring_count(struct ring *r)
+{
+	return atomic_load_explicit(&r->head, memory_order_acquire) -
+	    atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+#endif
@@ -0,0 +1,451 @@
+/*
+ * The snapshot of the aircraft table, for web front-ends
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "air.h"
+#include "out.h"
+#include "snap.h"
+
+#define SNAP_BIN_HDR  24
+
+/*
+ * The formatting is by hand, into the preallocated buffer. Every record
+ * is bounded, so the buffer is sized up front and never checked.
+ */
+static char *put_s(char *p, const char *s)
+{
+	while (*s != 0)
+		*p++ = *s++;
+	return p;
+}
+
+static char *put_u(char *p, unsigned long v)
+{
+	char tmp[24];
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v != 0);
+	while (n != 0)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static char *put_i(char *p, long v)
+{
+	if (v < 0) {
+		*p++ = '-';
+		return put_u(p, -(unsigned long) v);
+	}
+	return put_u(p, v);
+}
+
+// A fixed point number v with d digits after the point.
+static char *put_fix(char *p, long v, int d)
+{
+	unsigned long a, div;
+	int i;
+
+	if (v < 0) {
+		*p++ = '-';
+		a = -(unsigned long) v;
+	} else {
+		a = v;
+	}
+	for (div = 1, i = 0; i < d; i++)
+		div *= 10;
+	p = put_u(p, a / div);
+	*p++ = '.';
+	a %= div;
+	for (i = d - 1; i >= 0; i--) {
+		p[i] = '0' + a % 10;
+		a /= 10;
+	}
+	return p + d;
+}
+
+static char *put_hex(char *p, unsigned long v, int n)
+{
+	int i;
+
+	for (i = n - 1; i >= 0; i--) {
+		p[i] = out_hex[v & 0xF];
+		v >>= 4;
+	}
+	return p + n;
+}
+
+// A binary angle in 1e-5 degree.
+static long deg5(int32_t a)
+{
+	return ((int64_t) a * 36000000 + (1LL << 31)) >> 32;
+}
+
+/*
+ * The RSSI in 0.1 dBFS, from the Beast byte, which is the amplitude:
+ * 200 log10(v/255), through a log2 in Q16 by repeated squaring.
+ */
+static int rssi_db(unsigned int v)
+{
+	uint32_t l, m;
+	int e, b;
+
+	if (v == 0)
+		return -495;
+	e = 31 - __builtin_clz(v);
+	l = e << 16;
+	m = (v << 16) >> e;
+	for (b = 1 << 15; b != 0; b >>= 1) {
+		m = ((uint64_t) m * m) >> 16;
+		if (m >= 2 << 16) {
+			m >>= 1;
+			l += b;
+		}
+	}
+	// 60.206 tenths of a dB per bit, log2(255) is 523917 in Q16.
+	return ((int64_t) l - 523917) * 60206 / (1000LL << 16);
+}
+
+static char *snap_json1(char *p, const struct snap1 *ap)
+{
+	int i;
+
+	p = put_s(p, "{\"hex\":\"");
+	p = put_hex(p, ap->addr, 6);
+	*p++ = '"';
+	if (ap->call[0] != 0) {
+		p = put_s(p, ",\"flight\":\"");
+		p = put_s(p, ap->call);
+		*p++ = '"';
+	}
+	if (ap->alt != AIR_NONE) {
+		p = put_s(p, ",\"alt_baro\":");
+		p = put_i(p, ap->alt);
+	}
+	if (ap->gs != AIR_NONE) {
+		p = put_s(p, ",\"gs\":");
+		p = put_i(p, ap->gs);
+	}
+	if (ap->track != AIR_NONE) {
+		p = put_s(p, ",\"track\":");
+		p = put_fix(p, ap->track, 2);
+	}
+	if (ap->vr != AIR_NONE) {
+		p = put_s(p, ",\"baro_rate\":");
+		p = put_i(p, ap->vr);
+	}
+	if (ap->seen_pos != UINT32_MAX) {
+		p = put_s(p, ",\"lat\":");
+		p = put_fix(p, deg5(ap->lat), 5);
+		p = put_s(p, ",\"lon\":");
+		p = put_fix(p, deg5(ap->lon), 5);
+		p = put_s(p, ",\"seen_pos\":");
+		p = put_fix(p, ap->seen_pos / 100, 1);
+	}
+	p = put_s(p, ",\"messages\":");
+	p = put_u(p, ap->messages);
+	p = put_s(p, ",\"seen\":");
+	p = put_fix(p, ap->seen / 100, 1);
+	p = put_s(p, ",\"rssi\":");
+	p = put_fix(p, rssi_db(ap->rssi), 1);
+	if (ap->has_last) {
+		p = put_s(p, ",\"last\":\"");
+		for (i = 0; i < 14; i++) {
+			*p++ = out_hex[ap->last[i] >> 4];
+			*p++ = out_hex[ap->last[i] & 0xF];
+		}
+		*p++ = '"';
+	}
+	*p++ = '}';
+	return p;
+}
+
+static size_t snap_json(struct snap *sp, int x)
+{
+	char *p = sp->out;
+	unsigned int i;
+
+	p = put_s(p, "{\"now\":");
+	p = put_fix(p, sp->now[x] / 100, 1);
+	p = put_s(p, ",\"messages\":");
+	p = put_u(p, sp->messages[x]);
+	p = put_s(p, ",\"aircraft\":[\n");
+	for (i = 0; i < sp->cnt[x]; i++) {
+		p = snap_json1(p, &sp->vec[x][i]);
+		if (i + 1 != sp->cnt[x])
+			*p++ = ',';
+		*p++ = '\n';
+	}
+	p = put_s(p, "]}\n");
+	return p - sp->out;
+}
+
+static unsigned char *put_le(unsigned char *p, uint64_t v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		*p++ = v & 0xFF;
+		v >>= 8;
+	}
+	return p;
+}
+
+/*
+ * The binary is a header of 24 bytes: the magic, the version 1, the size
+ * of a record, the count, 4 zero bytes, and the time in ms. Then records
+ * of SNAP_BIN_REC bytes, all little-endian. The flags say which fields
+ * are valid: 1 position, 2 altitude, 4 speed and track, 8 vertical rate,
+ * 16 the last DF17, 32 the identification.
+ */
+static size_t snap_bin(struct snap *sp, int x)
+{
+	unsigned char *p = (unsigned char *) sp->out;
+	const struct snap1 *ap;
+	unsigned int i, flags;
+
+	p = put_le(p, SNAP_BIN_MAGIC, 4);
+	p = put_le(p, 1, 2);
+	p = put_le(p, SNAP_BIN_REC, 2);
+	p = put_le(p, sp->cnt[x], 4);
+	p = put_le(p, 0, 4);
+	p = put_le(p, sp->now[x], 8);
+	for (i = 0; i < sp->cnt[x]; i++) {
+		ap = &sp->vec[x][i];
+		memset(p, 0, SNAP_BIN_REC);
+		flags = 0;
+		if (ap->seen_pos != UINT32_MAX)
+			flags |= 1;
+		if (ap->alt != AIR_NONE)
+			flags |= 2;
+		if (ap->gs != AIR_NONE && ap->track != AIR_NONE)
+			flags |= 4;
+		if (ap->vr != AIR_NONE)
+			flags |= 8;
+		if (ap->has_last)
+			flags |= 16;
+		if (ap->call[0] != 0)
+			flags |= 32;
+		put_le(p + 0, ap->addr, 4);
+		put_le(p + 4, ap->seen, 4);
+		put_le(p + 8, ap->seen_pos, 4);
+		put_le(p + 12, ap->messages, 4);
+		put_le(p + 16, (uint32_t) ap->lat, 4);
+		put_le(p + 20, (uint32_t) ap->lon, 4);
+		put_le(p + 24, (uint32_t) ap->alt, 4);
+		put_le(p + 28, (uint16_t) ap->gs, 2);
+		put_le(p + 30, (uint16_t) ap->track, 2);
+		put_le(p + 32, (uint16_t) ap->vr, 2);
+		p[34] = ap->rssi;
+		p[35] = flags;
+		memcpy(p + 36, ap->call, 8);
+		memcpy(p + 44, ap->last, 14);
+		p += SNAP_BIN_REC;
+	}
+	return p - (unsigned char *) sp->out;
+}
+
+static int snap_write(const char *tmp, const char *name, const char *buf,
+    size_t len)
+{
+	ssize_t rc;
+	int fd;
+
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd == -1)
+		return -1;
+	while (len != 0) {
+		rc = write(fd, buf, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			return -1;
+		}
+		buf += rc;
+		len -= rc;
+	}
+	if (close(fd) != 0)
+		return -1;
+	return rename(tmp, name);
+}
+
+static void *snap_thread(void *arg)
+{
+	struct snap *sp = arg;
+	size_t len;
+	int x, rc;
+
+	pthread_mutex_lock(&sp->mutex);
+	for (;;) {
+		while (!sp->busy && !sp->closing)
+			pthread_cond_wait(&sp->cond, &sp->mutex);
+		if (!sp->busy)
+			break;
+		x = sp->back ^ 1;
+		pthread_mutex_unlock(&sp->mutex);
+
+		len = snap_json(sp, x);
+		rc = snap_write(sp->tmp_name, sp->name, sp->out, len);
+		if (rc == 0 && sp->bin_name != NULL) {
+			len = snap_bin(sp, x);
+			rc = snap_write(sp->bin_tmp, sp->bin_name, sp->out, len);
+		}
+
+		pthread_mutex_lock(&sp->mutex);
+		if (rc != 0) {
+			if (sp->st.errors++ == 0)
+				fprintf(stderr, "%s: write error: %s\n",
+				    sp->name, strerror(errno));
+		} else {
+			sp->st.written++;
+		}
+		sp->busy = 0;
+	}
+	pthread_mutex_unlock(&sp->mutex);
+	return NULL;
+}
+
+static char *tmp_name(const char *name)
+{
+	char *s;
+
+	s = malloc(strlen(name) + sizeof(".tmp"));
+	if (s != NULL) {
+		strcpy(s, name);
+		strcat(s, ".tmp");
+	}
+	return s;
+}
+
+int snap_open(struct snap *sp, const char *name, const char *bin_name)
+{
+	size_t n;
+	int rc;
+
+	memset(sp, 0, sizeof(struct snap));
+	sp->name = name;
+	sp->bin_name = bin_name;
+	sp->tmp_name = tmp_name(name);
+	sp->bin_tmp = (bin_name != NULL) ? tmp_name(bin_name) : NULL;
+	sp->vec[0] = calloc(AIR_SIZE, sizeof(struct snap1));
+	sp->vec[1] = calloc(AIR_SIZE, sizeof(struct snap1));
+	n = (size_t) AIR_SIZE * SNAP_REC + 100;
+	if (n < (size_t) AIR_SIZE * SNAP_BIN_REC + SNAP_BIN_HDR)
+		n = (size_t) AIR_SIZE * SNAP_BIN_REC + SNAP_BIN_HDR;
+	sp->out_size = n;
+	sp->out = malloc(n);
+	if (sp->tmp_name == NULL || (bin_name != NULL && sp->bin_tmp == NULL) ||
+	    sp->vec[0] == NULL || sp->vec[1] == NULL || sp->out == NULL) {
+		fprintf(stderr, "%s: no core for the snapshot\n", name);
+		goto err_alloc;
+	}
+
+	pthread_mutex_init(&sp->mutex, NULL);
+	pthread_cond_init(&sp->cond, NULL);
+	rc = pthread_create(&sp->thread, NULL, snap_thread, sp);
+	if (rc != 0) {
+		fprintf(stderr, "%s: pthread_create() failed: %d\n",
+		    name, rc);
+		goto err_alloc;
+	}
+	return 0;
+
+err_alloc:
+	free(sp->out);
+	free(sp->vec[1]);
+	free(sp->vec[0]);
+	free(sp->bin_tmp);
+	free(sp->tmp_name);
+	return -1;
+}
+
+/*
+ * Only call this from the thread that owns the table. The lock is only
+ * taken to look at the writer and to flip the buffers.
+ */
+void snap_take(struct snap *sp, const struct air *tab, uint64_t ms,
+    uint64_t rt_ms, unsigned long messages)
+{
+	const struct aircraft *ap;
+	struct snap1 *dp;
+	unsigned int i, n;
+	int busy;
+
+	pthread_mutex_lock(&sp->mutex);
+	busy = sp->busy;
+	if (busy)
+		sp->st.skipped++;
+	pthread_mutex_unlock(&sp->mutex);
+	if (busy)
+		return;
+
+	n = 0;
+	for (i = 0; i < AIR_SIZE; i++) {
+		ap = &tab->vec[i];
+		if (!ap->used)
+			continue;
+		dp = &sp->vec[sp->back][n++];
+		dp->addr = ap->addr;
+		dp->seen = air_age(ms, ap->seen);
+		dp->seen_pos = ap->pos_seen ?
+		    air_age(ms, ap->pos_seen) : UINT32_MAX;
+		dp->messages = ap->messages;
+		dp->lat = ap->lat;
+		dp->lon = ap->lon;
+		dp->alt = ap->alt;
+		dp->gs = ap->gs;
+		dp->track = ap->track;
+		dp->vr = ap->vr;
+		dp->rssi = ap->rssi;
+		memcpy(dp->call, ap->call, sizeof(dp->call));
+		dp->has_last = (ap->last_seen != 0);
+		memcpy(dp->last, ap->last, 14);
+	}
+	sp->cnt[sp->back] = n;
+	sp->now[sp->back] = rt_ms;
+	sp->messages[sp->back] = messages;
+
+	pthread_mutex_lock(&sp->mutex);
+	sp->back ^= 1;
+	sp->busy = 1;
+	pthread_cond_signal(&sp->cond);
+	pthread_mutex_unlock(&sp->mutex);
+}
+
+/*
+ * Fetch the counts accumulated since the previous call.
+ */
+void snap_stats(struct snap *sp, struct snap_stats *stp)
+{
+	pthread_mutex_lock(&sp->mutex);
+	*stp = sp->st;
+	memset(&sp->st, 0, sizeof(struct snap_stats));
+	pthread_mutex_unlock(&sp->mutex);
+}
+
+/*
+ * The last snapshot handed over is written before we return.
+ */
+void snap_close(struct snap *sp)
+{
+	pthread_mutex_lock(&sp->mutex);
+	sp->closing = 1;
+	pthread_cond_signal(&sp->cond);
+	pthread_mutex_unlock(&sp->mutex);
+	pthread_join(sp->thread, NULL);
+	free(sp->out);
+	free(sp->vec[1]);
+	free(sp->vec[0]);
+	free(sp->bin_tmp);
+	free(sp->tmp_name);
+}
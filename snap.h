@@ -0,0 +1,62 @@
+/*
+ * The snapshot of the aircraft table, for web front-ends
+ *
+ * Once a second, the main thread copies the live aircraft into the back
+ * one of two buffers, and hands it over to the writer thread. The writer
+ * formats it into aircraft.json (and optionally a compact binary file)
+ * in a preallocated buffer, and replaces the file with a rename(), so that
+ * readers never see a partial file. The main thread only takes the lock
+ * to flip the buffers, and skips the snapshot if the writer is behind.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define SNAP_REC     400	// the longest aircraft in the JSON
+#define SNAP_BIN_REC 64		// an aircraft in the binary
+#define SNAP_BIN_MAGIC  0x4e534159	// "YASN", little-endian
+
+struct snap1 {
+	uint32_t addr;
+	uint32_t seen;		// ms ago
+	uint32_t seen_pos;	// ms ago, or UINT32_MAX
+	uint32_t messages;
+	int32_t lat, lon;
+	int alt, gs, track, vr;
+	unsigned int rssi;
+	char call[9];
+	int has_last;
+	unsigned char last[14];
+};
+
+struct snap_stats {
+	unsigned long written;
+	unsigned long skipped;	// the writer was still busy
+	unsigned long errors;
+};
+
+struct snap {
+	const char *name, *bin_name;	// bin_name may be NULL
+	char *tmp_name, *bin_tmp;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct snap1 *vec[2];
+	unsigned int cnt[2];
+	uint64_t now[2];	// CLOCK_REALTIME, ms
+	unsigned long messages[2];
+	int back;		// the buffer that the main thread fills
+	int busy;		// the writer has the other one
+	int closing;
+	char *out;		// the formatted file
+	size_t out_size;
+	struct snap_stats st;	// under the mutex
+};
+
+struct air;
+
+int snap_open(struct snap *sp, const char *name, const char *bin_name);
+void snap_take(struct snap *sp, const struct air *tab, uint64_t ms,
+    uint64_t rt_ms, unsigned long messages);
+void snap_stats(struct snap *sp, struct snap_stats *stp);
+void snap_close(struct snap *sp);
@@ -0,0 +1,201 @@
+/*
+ * Test of the aircraft state
+ *
+ * Runs the well-known squitters from "The 1090 MHz Riddle" through the
+ * table and checks the identification, the altitude, the velocity, and
+ * the global and local CPR positions. Then encodes positions around the
+ * world and decodes them back, and sweeps the NL() across the latitudes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "air.h"
+
+#define TAG "testair"
+
+#define DEG(a)  ((a) * (360.0 / 4294967296.0))
+#define BIN(d)  ((int32_t) ((d) * (4294967296.0 / 360.0)))
+
+static const double place[][2] = {
+	{ -33.946, 151.177 },
+	{ -54.843, -68.296 },
+	{ 63.985, -22.606 },
+	{ 0.457, 179.981 },
+	{ -0.457, -179.981 },
+	{ 78.246, 15.466 },
+	{ -77.846, 166.668 },
+};
+#define NPLACE  (sizeof(place) / sizeof(place[0]))
+
+static struct air tab;
+static unsigned long fails;
+
+static void hex(unsigned char *pkt, const char *s)
+{
+	unsigned int v;
+	int i;
+
+	for (i = 0; i < 14; i++) {
+		sscanf(s + i*2, "%2x", &v);
+		pkt[i] = v;
+	}
+}
+
+static void check(const char *what, double got, double want, double tol)
+{
+	if (got < want - tol || got > want + tol) {
+		fprintf(stderr, TAG ": %s is %f, must be %f\n", what, got, want);
+		fails++;
+	}
+}
+
+static double floor_d(double x)
+{
+	double f = (double) (long) x;
+	return (f > x) ? f - 1.0 : f;
+}
+
+// The CPR encoding, straight from the book, in floating point.
+static void cpr_enc(double lat, double lon, int odd, uint32_t *yzp,
+    uint32_t *xzp)
+{
+	double dlat, dlon, rlat;
+	uint32_t yz;
+	int ni;
+
+	dlat = 360.0 / (60 - odd);
+	yz = (uint32_t) floor_d(131072.0 *
+	    (lat - dlat * floor_d(lat / dlat)) / dlat + 0.5);
+	rlat = dlat * (yz / 131072.0 + floor_d(lat / dlat));
+	yz &= 0x1FFFF;
+	ni = cpr_nl(BIN(rlat)) - odd;
+	if (ni < 1)
+		ni = 1;
+	dlon = 360.0 / ni;
+	*yzp = yz;
+	*xzp = (uint32_t) floor_d(131072.0 *
+	    (lon - dlon * floor_d(lon / dlon)) / dlon + 0.5) & 0x1FFFF;
+}
+
+static void round_trip(double lat, double lon)
+{
+	uint32_t yz[2], xz[2];
+	int32_t rlat, rlon;
+	char what[80];
+	int odd;
+
+	for (odd = 0; odd < 2; odd++)
+		cpr_enc(lat, lon, odd, &yz[odd], &xz[odd]);
+	for (odd = 0; odd < 2; odd++) {
+		snprintf(what, sizeof(what), "global %d at %.3f %.3f",
+		    odd, lat, lon);
+		if (cpr_global(yz, xz, odd, &rlat, &rlon) != 0) {
+			fprintf(stderr, TAG ": no %s\n", what);
+			fails++;
+			continue;
+		}
+		check(what, DEG(rlat), lat, 0.001);
+		check(what, DEG(rlon), lon, 0.001);
+
+		snprintf(what, sizeof(what), "local %d at %.3f %.3f",
+		    odd, lat, lon);
+		cpr_local(yz[odd], xz[odd], odd, BIN(lat + 0.3),
+		    BIN(lon - 0.3), &rlat, &rlon);
+		check(what, DEG(rlat), lat, 0.001);
+		check(what, DEG(rlon), lon, 0.001);
+	}
+}
+
+static struct aircraft *feed(const char *s, uint64_t ms)
+{
+	unsigned char pkt[14];
+
+	hex(pkt, s);
+	return air_update(&tab, pkt, 14, ms, 0);
+}
+
+int main(int argc, char **argv) {
+	struct aircraft *ap;
+	int32_t lat, lon;
+	unsigned long n;
+	int nl, prev;
+	unsigned int i;
+	double d;
+
+	air_init(&tab);
+
+	ap = feed("8D4840D6202CC371C32CE0576098", 1000);
+	if (ap == NULL || strcmp(ap->call, "KLM1023") != 0) {
+		fprintf(stderr, TAG ": identification is wrong\n");
+		fails++;
+	}
+
+	ap = feed("8D485020994409940838175B284F", 1000);
+	check("ground speed", ap->gs, 159, 0.5);
+	check("track", ap->track / 100.0, 182.88, 0.02);
+	check("vertical rate", ap->vr, -832, 0);
+
+	// The odd first, then the even, which is the latest.
+	feed("8D40621D58C386435CC412692AD6", 2000);
+	ap = feed("8D40621D58C382D690C8AC2863A7", 2500);
+	check("altitude", ap->alt, 38000, 0);
+	check("global latitude", DEG(ap->lat), 52.25720, 0.00001);
+	check("global longitude", DEG(ap->lon), 3.91937, 0.00001);
+	if (tab.st.global != 1) {
+		fprintf(stderr, TAG ": no global fix\n");
+		fails++;
+	}
+
+	// The same pair as a DF18 of a non-transponder, with the GNSS height.
+	feed("9040621EA0C386435CC412692AD6", 3000);
+	ap = feed("9040621EA0C382D690C8AC2863A7", 3500);
+	check("DF18 altitude", ap->alt, AIR_NONE, 0);
+	check("DF18 latitude", DEG(ap->lat), 52.25720, 0.00001);
+	check("DF18 longitude", DEG(ap->lon), 3.91937, 0.00001);
+
+	// A frame from another source may come a little late, and still pairs.
+	n = tab.st.global;
+	feed("8D40621F58C382D690C8AC2863A7", 5500);
+	feed("8D40621F58C386435CC412692AD6", 5000);
+	if (tab.st.global != n + 1) {
+		fprintf(stderr, TAG ": no global fix from a late frame\n");
+		fails++;
+	}
+
+	// The TIS-B is about someone else, so it only counts as heard.
+	ap = feed("92485021994409940838175B284F", 4000);
+	check("TIS-B ground speed", ap->gs, AIR_NONE, 0);
+
+	if (cpr_local(93000, 51372, 0, BIN(52.258), BIN(3.918),
+	    &lat, &lon) != 0) {
+		fprintf(stderr, TAG ": no local fix\n");
+		fails++;
+	}
+	check("local latitude", DEG(lat), 52.25720, 0.00001);
+	check("local longitude", DEG(lon), 3.91937, 0.00001);
+
+	// Around the world, where the binary angles wrap, by a round trip.
+	for (i = 0; i < NPLACE; i++)
+		round_trip(place[i][0], place[i][1]);
+
+	prev = 59;
+	for (d = 0.0; d < 90.0; d += 0.001) {
+		nl = cpr_nl(BIN(d));
+		if (nl != cpr_nl(BIN(-d)) || nl > prev || nl < prev - 1) {
+			fprintf(stderr, TAG ": NL(%f) is %d\n", d, nl);
+			fails++;
+			break;
+		}
+		prev = nl;
+	}
+	check("NL(10.47)", cpr_nl(BIN(10.47)), 59, 0);
+	check("NL(10.48)", cpr_nl(BIN(10.48)), 58, 0);
+	check("NL(52.25)", cpr_nl(BIN(52.25)), 36, 0);
+	check("NL(86.9)", cpr_nl(BIN(86.9)), 2, 0);
+	check("NL(87.1)", cpr_nl(BIN(87.1)), 1, 0);
+
+	printf("failed %lu\n", fails);
+	return fails != 0;
+}
@@ -1,12 +1,18 @@
 /*
  * Test of the correlation
+ *
+ * Prints the correlator output for every decimated sample. With -n,
+ * runs the samples through the correlator that many times instead,
+ * and prints how long a call takes.
  */
 
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "icao.h"
 #include "upd.h"
 #include "yoga.h"
 
@@ -14,41 +20,19 @@
 
 static struct rstate rs;
 
+static int *vvec;		// raw values, then smoothed
+static unsigned int vcnt, vmax;
+
 static void Usage(void) {
-	fprintf(stderr, "Usage: test_cor [datafile]\n");
+	fprintf(stderr, "Usage: test_cor [-m ring|mask] [-n repeat] [datafile]\n");
 	exit(1);
 }
 
-int main(int argc, char **argv) {
-	char *input_name;
-	FILE *ifp;
+static void read_values(FILE *ifp)
+{
 	char line[80], *nump, *endp;
 	long value;
-	int p;
-	int cv;
-
-	upd_init(&rs.smoo, AVGLEN);
-
-	if (argc == 1) {
-		ifp = stdin;
-	} else if (argc == 2) {
-		input_name = argv[1];
-		if (input_name[0] == '-') {
-			if (input_name[1] != 0) {
-				Usage();
-			}
-			ifp = stdin;
-		} else {
-			ifp = fopen(input_name, "r");
-			if (ifp == NULL) {
-				fprintf(stderr, TAG ": Cannot open %s: %s\n",
-				    input_name, strerror(errno));
-				exit(1);
-			}
-		}
-	} else {
-		Usage();
-	}
+	int *p;
 
 	while (fgets(line, 80, ifp) != NULL) {
 		nump = strtok(line, " \t\n");
@@ -63,13 +47,119 @@ int main(int argc, char **argv) {
 			fprintf(stderr, TAG ": Invalid value: %ld\n", value);
 			continue;
 		}
-		p = upd_ate(&rs.smoo, abs((int)value));
-		if (++rs.dec >= DF) {
-			cv = preamble_match(&rs, p);
-			printf("%d\n", cv);
+		if (vcnt == vmax) {
+			vmax = vmax ? vmax * 2 : 1024;
+			p = realloc(vvec, vmax * sizeof(int));
+			if (p == NULL) {
+				fprintf(stderr, TAG ": No core\n");
+				exit(1);
+			}
+			vvec = p;
+		}
+		vvec[vcnt++] = value;
+	}
+}
+
+/*
+ * Smooth once, so that the timing is of the correlator alone.
+ */
+static void smooth_values(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < vcnt; i++)
+		vvec[i] = upd_ate(&rs.smoo, abs(vvec[i]));
+}
+
+/*
+ * Returns the number of matches.
+ */
+static unsigned long run(int verbose)
+{
+	unsigned long matches = 0;
+	unsigned int i;
+	int cv;
+
+	for (i = 0; i < vcnt; i++) {
+		if (++rs.dec >= rs.var->df) {
+			cv = (*rs.pre_match)(&rs, vvec[i]);
+			if (verbose)
+				printf("%d\n", cv);
+			matches += cv;
 			rs.dec = 0;
 		}
 	}
+	return matches;
+}
+
+int main(int argc, char **argv) {
+	char *input_name = NULL;
+	char *arg;
+	FILE *ifp;
+	unsigned long repeat = 0, matches, calls, k;
+	struct timespec t0, t1;
+	double secs;
+	int ring = 0;
+
+	argv++;
+	while ((arg = *argv++) != NULL) {
+		if (strcmp(arg, "-m") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			if (strcmp(arg, "ring") == 0)
+				ring = 1;
+			else if (strcmp(arg, "mask") == 0)
+				ring = 0;
+			else
+				Usage();
+		} else if (strcmp(arg, "-n") == 0) {
+			if ((arg = *argv++) == NULL)
+				Usage();
+			repeat = strtoul(arg, NULL, 10);
+			if (repeat == 0)
+				Usage();
+		} else if (arg[0] == '-' && arg[1] != 0) {
+			Usage();
+		} else if (input_name == NULL) {
+			input_name = arg;
+		} else {
+			Usage();
+		}
+	}
+
+	if (rstate_init(&rs, dvar_find(NULL), NULL) != 0) {
+		fprintf(stderr, TAG ": No core\n");
+		exit(1);
+	}
+	rs.pre_match = ring ? rs.var->pre_ring : rs.var->pre_mask;
+
+	if (input_name == NULL || strcmp(input_name, "-") == 0) {
+		ifp = stdin;
+	} else {
+		ifp = fopen(input_name, "r");
+		if (ifp == NULL) {
+			fprintf(stderr, TAG ": Cannot open %s: %s\n",
+			    input_name, strerror(errno));
+			exit(1);
+		}
+	}
+	read_values(ifp);
+	smooth_values();
+
+	if (repeat == 0) {
+		run(1);
+		return 0;
+	}
 
+	matches = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < repeat; k++)
+		matches += run(0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	calls = repeat * (vcnt / rs.var->df);
+	printf("%s calls %lu matches %lu ns/call %.2f\n",
+	    ring ? "ring" : "mask", calls, matches,
+	    calls ? secs * 1e9 / calls : 0.0);
 	return 0;
 }
@@ -0,0 +1,115 @@
+/*
+ * Test of the CRC and of the error correction
+ *
+ * Compares the table-driven CRC with a bit-by-bit one on random frames,
+ * then breaks good long frames in every 1-bit and 2-bit way that the
+ * correction claims to fix, and checks that they come back intact.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc.h"
+
+#define TAG "testcrc"
+
+static unsigned long long rnd_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned int rnd32(void)
+{
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return (rnd_state * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static uint32_t crc_ref(const unsigned char *p, int n)
+{
+	uint32_t crc;
+	int i, j;
+
+	crc = 0;
+	for (i = 0; i < n; i++) {
+		crc ^= p[i] << 16;
+		for (j = 0; j < 8; j++) {
+			crc <<= 1;
+			if (crc & 0x1000000)
+				crc ^= 0x1fff409;
+		}
+	}
+	return crc & 0xffffff;
+}
+
+static void make_frame(unsigned char *pkt)
+{
+	uint32_t crc;
+	int i;
+
+	pkt[0] = (17 << 3) | 5;
+	for (i = 1; i < 11; i++)
+		pkt[i] = rnd32();
+	crc = crc_ref(pkt, 11);
+	pkt[11] = crc >> 16;
+	pkt[12] = crc >> 8;
+	pkt[13] = crc;
+}
+
+static void flip(unsigned char *pkt, int bit)
+{
+	pkt[bit >> 3] ^= 0x80 >> (bit & 7);
+}
+
+int main(int argc, char **argv) {
+	unsigned char buf[64], pkt[14], bad[14];
+	unsigned long fails = 0, fixed = 0;
+	int i, j, n, k;
+
+	crc_init();
+
+	for (k = 0; k < 10000; k++) {
+		n = rnd32() % 64;
+		for (i = 0; i < n; i++)
+			buf[i] = rnd32();
+		if (crc_bytes(buf, n) != crc_ref(buf, n)) {
+			fprintf(stderr, TAG ": CRC mismatch, length %d\n", n);
+			fails++;
+		}
+	}
+
+	for (k = 0; k < 20; k++) {
+		make_frame(pkt);
+		if (crc_syndrome(pkt, 14) != 0) {
+			fprintf(stderr, TAG ": good frame has a syndrome\n");
+			fails++;
+		}
+		for (i = 5; i < 112; i++) {
+			for (j = i; j < 112; j++) {
+				memcpy(bad, pkt, 14);
+				flip(bad, i);
+				if (j != i)
+					flip(bad, j);
+				if (crc_fix(bad, crc_syndrome(bad, 14),
+				    CRC_FIX_MAX) != (j == i ? 1 : 2) ||
+				    memcmp(bad, pkt, 14) != 0) {
+					fprintf(stderr, TAG ": not fixed:"
+					    " bits %d %d\n", i, j);
+					fails++;
+				} else {
+					fixed++;
+				}
+			}
+		}
+		// A 1-bit fix must not take on a 2-bit error.
+		memcpy(bad, pkt, 14);
+		flip(bad, 20);
+		flip(bad, 60);
+		if (crc_fix(bad, crc_syndrome(bad, 14), 1) != -1) {
+			fprintf(stderr, TAG ": 2 bits fixed with 1\n");
+			fails++;
+		}
+	}
+
+	printf("fixed %lu failed %lu\n", fixed, fails);
+	return fails != 0;
+}
@@ -0,0 +1,354 @@
+/*
+ * Generator of Mode S test signals
+ *
+ * The output is a raw recording, just like airspy_yoga -w makes: real
+ * samples at 20 Ms/s (or -r) with the 1090 MHz carrier at the IF of fs/4.
+ * Frames are DF11 and DF17 squitters with a correct parity, and with -a
+ * some DF4 and DF20 replies with the address in the parity, added to
+ * Gaussian noise.
+ * The truth goes to standard output, one frame per line: the sample index
+ * where the preamble starts, and the frame in hex.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "testgen"
+
+#define FS        (par.fs)
+#define F_IF      (FS/4)
+
+// Samples per half-bit, 10 at 20 Ms/s. Not necessarily whole.
+#define SPH       (FS/2000000.0)
+
+// The longest frame: 8 us of preamble and 112 bits, in half-bits,
+// at the highest rate that we make.
+#define HMAX      (16 + 112*2)
+#define FS_MAX    20000000.0
+#define FRAME_MAX (HMAX*10 + 2)
+
+#define CHUNK     (1024*1024)
+
+#define NICAO     64
+
+struct param {
+	char *out_name;
+	double fs;		// sample rate
+	double duration;	// in seconds
+	double rate;		// frames per second
+	double snr;		// in dB, of the carrier against the noise
+	double sigma;		// noise, in ADC counts
+	double offset;		// carrier offset from the IF, in Hz
+	double phase;		// sample phase, 0.0 to 1.0, or random if < 0
+	double long_frac;	// share of long frames
+	double ap_frac;		// share of replies with the address parity
+	int overlap;
+	unsigned long seed;
+};
+
+static struct param par;
+
+static unsigned long long rnd_state;
+static unsigned int icao_vec[NICAO];
+
+static double acc[CHUNK + FRAME_MAX];
+
+static void Usage(void) {
+	fprintf(stderr, "Usage: test_gen -o file.raw [-r Ms/s] [-d seconds] [-f rate]"
+	    " [-s snr_db] [-n sigma] [-F offset_hz] [-p phase] [-l long_frac]"
+	    " [-a ap_frac] [-O] [-R seed]\n");
+	exit(1);
+}
+
+// The xorshift64* by Vigna, good enough for noise and reproducible.
+static unsigned long long rnd64(void)
+{
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return rnd_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in (0.0, 1.0]
+static double rnd_u(void)
+{
+	return ((rnd64() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double rnd_gauss(void)
+{
+	static int have;
+	static double saved;
+	double r, phi;
+
+	if (have) {
+		have = 0;
+		return saved;
+	}
+	r = sqrt(-2.0 * log(rnd_u()));
+	phi = 2.0 * M_PI * rnd_u();
+	saved = r * sin(phi);
+	have = 1;
+	return r * cos(phi);
+}
+
+/*
+ * The reference CRC: bit by bit, no tables, so it cannot share a bug
+ * with the decoder that we test.
+ */
+static unsigned int crc24(const unsigned char *p, int n)
+{
+	unsigned int crc;
+	int i, j;
+
+	crc = 0;
+	for (i = 0; i < n; i++) {
+		crc ^= p[i] << 16;
+		for (j = 0; j < 8; j++) {
+			crc <<= 1;
+			if (crc & 0x1000000)
+				crc ^= 0x1fff409;
+		}
+	}
+	return crc & 0xffffff;
+}
+
+static int make_frame(unsigned char *pkt)
+{
+	unsigned int icao, crc;
+	int len, i;
+
+	icao = icao_vec[rnd64() % NICAO];
+	if (rnd_u() < par.ap_frac) {
+		// The altitude replies, the AP is the CRC XOR the address.
+		if (rnd_u() <= par.long_frac) {
+			len = 14;
+			pkt[0] = 20 << 3;
+		} else {
+			len = 7;
+			pkt[0] = 4 << 3;
+		}
+		for (i = 1; i < len - 3; i++)
+			pkt[i] = rnd64() & 0xFF;
+		crc = crc24(pkt, len - 3) ^ icao;
+		pkt[len-3] = crc >> 16;
+		pkt[len-2] = crc >> 8;
+		pkt[len-1] = crc;
+		return len;
+	}
+	if (rnd_u() <= par.long_frac) {
+		len = 14;
+		pkt[0] = (17 << 3) | 5;
+		for (i = 4; i < 11; i++)
+			pkt[i] = rnd64() & 0xFF;
+	} else {
+		len = 7;
+		pkt[0] = (11 << 3) | 5;
+	}
+	pkt[1] = icao >> 16;
+	pkt[2] = icao >> 8;
+	pkt[3] = icao;
+	crc = crc24(pkt, len - 3);
+	pkt[len-3] = crc >> 16;
+	pkt[len-2] = crc >> 8;
+	pkt[len-1] = crc;
+	return len;
+}
+
+/*
+ * Add a frame that starts at t0, counted in samples from the start of acc[].
+ */
+static void add_frame(double t0, const unsigned char *pkt, int len)
+{
+	unsigned char on[HMAX];
+	double amp, w, phi;
+	int n, n0, nh;
+	int h, i;
+
+	memset(on, 0, HMAX);
+	on[0] = on[2] = on[7] = on[9] = 1;
+	for (i = 0; i < len*8; i++) {
+		if (pkt[i >> 3] & (0x80 >> (i & 7)))
+			on[16 + 2*i] = 1;
+		else
+			on[16 + 2*i + 1] = 1;
+	}
+	nh = 16 + len*8*2;
+
+	amp = par.sigma * sqrt(2.0 * pow(10.0, par.snr / 10.0));
+	w = 2.0 * M_PI * (F_IF + par.offset) / FS;
+	phi = 2.0 * M_PI * rnd_u();
+
+	n0 = (int) ceil(t0);
+	for (n = n0; n < n0 + nh*SPH + 1; n++) {
+		h = (int) floor((n - t0) / SPH);
+		if (h < 0 || h >= nh)
+			continue;
+		if (on[h])
+			acc[n] += amp * cos(w * n + phi);
+	}
+}
+
+static void parse(struct param *p, char **argv) {
+	char *arg;
+
+	memset(p, 0, sizeof(struct param));
+	p->fs = FS_MAX;
+	p->duration = 1.0;
+	p->rate = 2000.0;
+	p->snr = 20.0;
+	p->sigma = 16.0;
+	p->phase = -1.0;
+	p->long_frac = 0.5;
+	p->seed = 1;
+
+	argv++;
+	while ((arg = *argv++) != NULL) {
+		if (arg[0] != '-' || arg[1] == 0 || arg[2] != 0)
+			Usage();
+		if (arg[1] == 'O') {
+			p->overlap = 1;
+			continue;
+		}
+		if ((arg = *argv++) == NULL) {
+			fprintf(stderr, TAG ": missing value\n");
+			Usage();
+		}
+		switch (argv[-2][1]) {
+		case 'o':
+			p->out_name = arg;
+			break;
+		case 'r':
+			p->fs = strtod(arg, NULL) * 1e6;
+			break;
+		case 'd':
+			p->duration = strtod(arg, NULL);
+			break;
+		case 'f':
+			p->rate = strtod(arg, NULL);
+			break;
+		case 's':
+			p->snr = strtod(arg, NULL);
+			break;
+		case 'n':
+			p->sigma = strtod(arg, NULL);
+			break;
+		case 'F':
+			p->offset = strtod(arg, NULL);
+			break;
+		case 'p':
+			p->phase = strtod(arg, NULL);
+			if (p->phase >= 1.0) {
+				fprintf(stderr, TAG ": invalid -p phase\n");
+				Usage();
+			}
+			break;
+		case 'l':
+			p->long_frac = strtod(arg, NULL);
+			break;
+		case 'a':
+			p->ap_frac = strtod(arg, NULL);
+			break;
+		case 'R':
+			p->seed = strtoul(arg, NULL, 10);
+			break;
+		default:
+			Usage();
+		}
+	}
+	if (p->out_name == NULL) {
+		fprintf(stderr, TAG ": missing -o file\n");
+		Usage();
+	}
+	if (p->fs < 4e6 || p->fs > FS_MAX) {
+		fprintf(stderr, TAG ": invalid -r sample rate\n");
+		Usage();
+	}
+	if (p->duration <= 0.0 || p->rate <= 0.0 || p->sigma < 0.0) {
+		fprintf(stderr, TAG ": invalid parameters\n");
+		Usage();
+	}
+}
+
+int main(int argc, char **argv) {
+	FILE *ofp;
+	unsigned char pkt[14];
+	static unsigned char obuf[CHUNK*2];
+	unsigned long total, base, nframes;
+	double t_next, t_end, frac;
+	int len, v;
+	int i;
+
+	parse(&par, argv);
+
+	rnd_state = 0x9E3779B97F4A7C15ULL ^ par.seed;
+	for (i = 0; i < NICAO; i++)
+		icao_vec[i] = rnd64() & 0xFFFFFF;
+
+	ofp = fopen(par.out_name, "wb");
+	if (ofp == NULL) {
+		fprintf(stderr, TAG ": Cannot open %s: %s\n",
+		    par.out_name, strerror(errno));
+		exit(1);
+	}
+
+	total = (unsigned long) (par.duration * FS);
+	nframes = 0;
+	t_end = 0.0;
+	t_next = 1000.0;
+	for (base = 0; base < total; base += CHUNK) {
+
+		/*
+		 * Frames that start in this chunk are added in full,
+		 * the tail spills into the next chunk.
+		 */
+		while (t_next < base + CHUNK && t_next + FRAME_MAX < total) {
+			if (!par.overlap && t_next < t_end) {
+				t_next = t_end + 1.0;
+				continue;
+			}
+			if (par.phase >= 0.0) {
+				frac = par.phase;
+				t_next = floor(t_next) + frac;
+			}
+			len = make_frame(pkt);
+			add_frame(t_next - base, pkt, len);
+			t_end = t_next + (16 + len*8*2) * SPH;
+			nframes++;
+
+			printf("%lu ", (unsigned long) ceil(t_next));
+			for (i = 0; i < len; i++)
+				printf("%02x", pkt[i]);
+			printf("\n");
+
+			t_next += -log(rnd_u()) * (FS / par.rate);
+		}
+
+		for (i = 0; i < CHUNK; i++) {
+			v = (int) lrint(2048.0 + acc[i] +
+			    par.sigma * rnd_gauss());
+			if (v < 0)
+				v = 0;
+			if (v > 4095)
+				v = 4095;
+			obuf[i*2] = v & 0xFF;
+			obuf[i*2+1] = v >> 8;
+		}
+		len = (total - base < CHUNK) ? total - base : CHUNK;
+		if (fwrite(obuf, 2, len, ofp) != len) {
+			fprintf(stderr, TAG ": Write error on %s\n",
+			    par.out_name);
+			exit(1);
+		}
+
+		memmove(acc, acc + CHUNK, FRAME_MAX * sizeof(double));
+		memset(acc + FRAME_MAX, 0, CHUNK * sizeof(double));
+	}
+	fclose(ofp);
+
+	fprintf(stderr, TAG ": %lu samples, %lu frames\n", total, nframes);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Test of the address cache
+ *
+ * Fills the cache with 10k addresses, checks that they are all found
+ * and that others are not, then lets them expire and refills it with
+ * new ones, many times over, so that the runs fill with expired slots.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "icao.h"
+
+#define TAG "testicao"
+
+#define NAIR   10000
+#define TTL    (60ULL * 20000000)
+
+static unsigned long long rnd_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned int rnd32(void)
+{
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return (rnd_state * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static struct icao ic;
+static uint32_t air[NAIR];
+
+int main(int argc, char **argv) {
+	unsigned long fails = 0, strays = 0;
+	uint64_t now;
+	int i, k;
+
+	icao_init(&ic, TTL);
+	now = 1000;
+	for (k = 0; k < 50; k++) {
+		for (i = 0; i < NAIR; i++) {
+			air[i] = rnd32() & 0xFFFFFF;
+			icao_add(&ic, air[i], now + i);
+		}
+		now += NAIR;
+		for (i = 0; i < NAIR; i++) {
+			if (!icao_seen(&ic, air[i], now)) {
+				fprintf(stderr, TAG ": lost %06x, round %d\n",
+				    air[i], k);
+				fails++;
+			}
+		}
+		// Random addresses hit the 10k in the 16M now and then.
+		for (i = 0; i < NAIR; i++)
+			strays += icao_seen(&ic, rnd32() & 0xFFFFFF, now);
+		if (icao_count(&ic, now) > NAIR) {
+			fprintf(stderr, TAG ": %u live, round %d\n",
+			    icao_count(&ic, now), k);
+			fails++;
+		}
+
+		now += TTL;
+		for (i = 0; i < NAIR; i++) {
+			if (icao_seen(&ic, air[i], now)) {
+				fprintf(stderr, TAG ": %06x did not expire\n",
+				    air[i]);
+				fails++;
+				break;
+			}
+		}
+	}
+
+	printf("strays %lu failed %lu\n", strays, fails);
+	return fails != 0;
+}
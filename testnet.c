@@ -0,0 +1,177 @@
+/*
+ * Test of the network output, over the loopback
+ *
+ * Connects a client that reads everything and one that never reads, then
+ * feeds frames in small flushes, so that the batches of the stalled one
+ * are merged and copied on write. The reader must get the stream byte for
+ * byte, and the stalled one must be cut once it lags by NET_QMAX, after
+ * an exact prefix of the same stream.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "net.h"
+
+#define TAG "testnet"
+
+#define NFRAME  100000		// a few times NET_QMAX in the AVR
+#define NROUND  50		// frames between the flushes
+
+static struct net net;
+static unsigned char *want;
+static unsigned long want_len;
+
+static int dial(int port, int rcvbuf)
+{
+	struct sockaddr_in sin;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	if (rcvbuf != 0)
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	memset(&sin, 0, sizeof(struct sockaddr_in));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Read what the socket has without waiting. Returns 0 at the end of
+ * the stream, -1 on an error, and 1 otherwise.
+ */
+static int drain(int fd, unsigned char *buf, unsigned long max,
+    unsigned long *lenp)
+{
+	ssize_t rc;
+
+	for (;;) {
+		if (*lenp == max)
+			return -1;
+		rc = recv(fd, buf + *lenp, max - *lenp, MSG_DONTWAIT);
+		if (rc > 0) {
+			*lenp += rc;
+			continue;
+		}
+		if (rc == 0)
+			return 0;
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 1;
+		return -1;
+	}
+}
+
+int main(int argc, char **argv) {
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	unsigned char pkt[14];
+	unsigned char *got, *cut;
+	unsigned long got_len, cut_len, cut_at, fails = 0;
+	struct ofr fr;
+	int efd, rfd, sfd;
+	int i, k;
+
+	want = malloc(NFRAME * OUT_REC);
+	got = malloc(NFRAME * OUT_REC);
+	cut = malloc(NFRAME * OUT_REC);
+	if (want == NULL || got == NULL || cut == NULL) {
+		fprintf(stderr, TAG ": No core\n");
+		return 1;
+	}
+
+	efd = eventfd(0, EFD_CLOEXEC);
+	if (efd == -1 || net_init(&net, efd) != 0 ||
+	    net_listen(&net, OUT_AVR_T, 0) != 0)
+		return 1;
+	getsockname(net.lv[0].fd, (struct sockaddr *) &sin, &slen);
+	rfd = dial(ntohs(sin.sin_port), 0);
+	sfd = dial(ntohs(sin.sin_port), 4096);
+	if (rfd == -1 || sfd == -1) {
+		fprintf(stderr, TAG ": cannot connect: %s\n", strerror(errno));
+		return 1;
+	}
+	for (k = 0; k < 100 && net.st.accepts != 2; k++) {
+		eventfd_write(efd, 1);
+		net_wait(&net);
+	}
+	if (net.st.accepts != 2) {
+		fprintf(stderr, TAG ": accepted %lu\n", net.st.accepts);
+		return 1;
+	}
+
+	memset(&fr, 0, sizeof(struct ofr));
+	fr.pkt = pkt;
+	fr.plen = 14;
+	got_len = 0;
+	cut_at = 0;
+	for (i = 0; i < NFRAME; i++) {
+		for (k = 0; k < 14; k++)
+			pkt[k] = (i * 131 + k * 7) & 0xFF;
+		fr.ts = (uint64_t) i * 12000;
+		fr.rssi = i & 0xFF;
+		want_len += out_enc(OUT_AVR_T, want + want_len, &fr);
+		net_frame(&net, &fr);
+		if (net.st.slow != 0 && cut_at == 0)
+			cut_at = want_len;
+		if (i % NROUND == NROUND - 1) {
+			net_flush(&net);
+			if (drain(rfd, got, NFRAME * OUT_REC, &got_len) != 1) {
+				fprintf(stderr, TAG ": the reader is cut\n");
+				fails++;
+				break;
+			}
+		}
+	}
+	net_flush(&net);
+	for (k = 0; k < 1000 && got_len < want_len; k++) {
+		usleep(1000);
+		net_flush(&net);
+		drain(rfd, got, NFRAME * OUT_REC, &got_len);
+	}
+	if (got_len != want_len || memcmp(got, want, want_len) != 0) {
+		fprintf(stderr, TAG ": the reader got %lu bytes of %lu, or"
+		    " wrong ones\n", got_len, want_len);
+		fails++;
+	}
+
+	cut_len = 0;
+	for (k = 0; k < 1000; k++) {
+		if (drain(sfd, cut, NFRAME * OUT_REC, &cut_len) != 1)
+			break;
+		usleep(1000);
+	}
+	if (net.st.slow != 1) {
+		fprintf(stderr, TAG ": %lu clients cut, must be 1\n",
+		    net.st.slow);
+		fails++;
+	}
+	// It may have the socket buffers, and a batch that did not fit.
+	if (cut_at + NET_BATCH < NET_QMAX) {
+		fprintf(stderr, TAG ": the stalled client is cut after %lu"
+		    " bytes, before NET_QMAX\n", cut_at);
+		fails++;
+	}
+	if (cut_len >= want_len || memcmp(cut, want, cut_len) != 0) {
+		fprintf(stderr, TAG ": the stalled client got %lu bytes,"
+		    " or wrong ones\n", cut_len);
+		fails++;
+	}
+
+	printf("sent %lu stalled %lu failed %lu\n", want_len, cut_len, fails);
+	return fails != 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Test of the Beast output
+ *
+ * Encodes frames with the escape in the clock, the signal, the payload
+ * and the receiver id, then decodes them back and checks that every
+ * field came out as it went in. The frame with all bytes escaped is
+ * the longest record, which must fit into OUT_REC.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "out.h"
+
+#define TAG "testout"
+
+#define ESC  0x1a
+
+static unsigned long fails;
+
+/*
+ * Take n bytes after *pp, undoing the doubled escapes. Returns -1 if an
+ * escape is not doubled.
+ */
+static int unesc(const unsigned char **pp, const unsigned char *end,
+    unsigned char *v, unsigned int n)
+{
+	const unsigned char *p = *pp;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (p == end)
+			return -1;
+		v[i] = *p++;
+		if (v[i] == ESC && (p == end || *p++ != ESC))
+			return -1;
+	}
+	*pp = p;
+	return 0;
+}
+
+static uint64_t be(const unsigned char *v, unsigned int n)
+{
+	uint64_t x = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		x = x << 8 | v[i];
+	return x;
+}
+
+static void round_trip(const char *what, const unsigned char *pkt,
+    unsigned int plen, uint64_t ts, unsigned int rssi, unsigned int src)
+{
+	unsigned char buf[OUT_REC * 2];
+	unsigned char v[8 + 7 + 14];
+	const unsigned char *p, *end;
+	struct ofr fr;
+	unsigned int n;
+
+	memset(&fr, 0, sizeof(struct ofr));
+	fr.pkt = pkt;
+	fr.plen = plen;
+	fr.ts = ts;
+	fr.rssi = rssi;
+	fr.src = src;
+	n = out_enc(OUT_BEAST, buf, &fr);
+	if (n > OUT_REC) {
+		fprintf(stderr, TAG ": %s: %u bytes, OUT_REC is %u\n",
+		    what, n, OUT_REC);
+		fails++;
+		return;
+	}
+
+	p = buf;
+	end = buf + n;
+	if (src != 0) {
+		if (end - p < 2 || p[0] != ESC || p[1] != 0xe3) {
+			fprintf(stderr, TAG ": %s: no receiver id\n", what);
+			fails++;
+			return;
+		}
+		p += 2;
+		if (unesc(&p, end, v, 8) != 0 || be(v, 8) != src) {
+			fprintf(stderr, TAG ": %s: wrong receiver id\n", what);
+			fails++;
+			return;
+		}
+	}
+	if (end - p < 2 || p[0] != ESC || p[1] != ((plen == 7) ? '2' : '3')) {
+		fprintf(stderr, TAG ": %s: no frame type\n", what);
+		fails++;
+		return;
+	}
+	p += 2;
+	if (unesc(&p, end, v, 7 + plen) != 0 || p != end) {
+		fprintf(stderr, TAG ": %s: bad escapes or length\n", what);
+		fails++;
+		return;
+	}
+	if (be(v, 6) != (ts & 0xFFFFFFFFFFFFULL) || v[6] != rssi ||
+	    memcmp(v + 7, pkt, plen) != 0) {
+		fprintf(stderr, TAG ": %s: wrong fields\n", what);
+		fails++;
+	}
+}
+
+int main(int argc, char **argv) {
+	static const unsigned char pkt[14] = {
+		0x8D, 0x1a, 0x40, 0xD6, 0x1a, 0x1a, 0xC3, 0x71,
+		0xC3, 0x2C, 0xE0, 0x57, 0x60, 0x1a,
+	};
+	unsigned char all[14];
+	unsigned char buf[OUT_REC * 2];
+	struct ofr fr;
+	unsigned int n;
+
+	round_trip("plain", pkt + 6, 7, 0x123456789ABCULL, 0x80, 0);
+	round_trip("long", pkt, 14, 0x123456789ABCULL, 0x80, 0);
+	round_trip("clock", pkt, 14, 0x1a00001a1a1aULL, 0x80, 0);
+	round_trip("signal", pkt, 14, 0x123456789ABCULL, ESC, 0);
+	round_trip("id", pkt, 14, 0x123456789ABCULL, 0x80, 0x1a001a1a);
+	round_trip("short id", pkt, 7, 0x1a, ESC, 0x1a);
+
+	// The worst case is an escape in every byte.
+	memset(all, ESC, sizeof(all));
+	round_trip("all escaped", all, 14, 0x1a1a1a1a1a1aULL, ESC, 0x1a1a1a1a);
+	round_trip("all escaped short", all, 7, 0x1a1a1a1a1a1aULL, ESC,
+	    0x1a1a1a1a);
+
+	// And the longest AVR, for the same bound.
+	memset(&fr, 0, sizeof(struct ofr));
+	fr.pkt = all;
+	fr.plen = 14;
+	n = out_enc(OUT_AVR_T, buf, &fr);
+	if (n > OUT_REC) {
+		fprintf(stderr, TAG ": AVR: %u bytes, OUT_REC is %u\n",
+		    n, OUT_REC);
+		fails++;
+	}
+
+	printf("failed %lu\n", fails);
+	return fails != 0;
+}
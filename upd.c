@@ -10,13 +10,25 @@
 int upd_init(struct upd *up, int length)
 {
 	void *p;
+	int l;
 
 	p = malloc(length * sizeof(int));
 	if (!p)
 		return -1;
+	memset(p, 0, length * sizeof(int));
 	memset(up, 0, sizeof(struct upd));
 	up->len = length;
 	up->vec = p;
+
+	/*
+	 * With l = ceil(log2(len)) and mul = ceil(2^(31+l) / len),
+	 * (n * mul) >> (31+l) is exactly n / len for every n < 2^31.
+	 */
+	l = 0;
+	while ((1 << l) < length)
+		l++;
+	up->shift = 31 + l;
+	up->mul = ((1ULL << up->shift) + length - 1) / length;
 	return 0;
 }
 
@@ -37,6 +49,19 @@ int upd_ate(struct upd *up, int p)
 	return up->cur / up->len;
 }
 
+void upd_block(struct upd *up, const int16_t *in, int16_t *out, size_t n)
+{
+	upd_block_t(up, in, out, n, up->len, 0);
+}
+
+/*
+ * The variant for the length of 7. It must only be used on such upd.
+ */
+void upd_block_7(struct upd *up, const int16_t *in, int16_t *out, size_t n)
+{
+	upd_block_t(up, in, out, n, 7, 1);
+}
+
 void upd_fini(struct upd *up)
 {
 	free(up->vec);
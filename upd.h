@@ -5,6 +5,9 @@
  * with a division by a variable size.
  */
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define AVG_UPD_P(pcur, sub, p)  { *(pcur) -= (sub);  *(pcur) += (p); }
 
 struct upd {
@@ -12,10 +15,67 @@ struct upd {
 	int cur;
 	int len;		// number of entries in vec[]
 	unsigned int x;
+	uint64_t mul;		// reciprocal of len, see upd_div()
+	unsigned int shift;
 };
 
 #define UPD_CUR(up) ((up)->cur / (up)->len)
 
 int upd_init(struct upd *up, int length);
 int upd_ate(struct upd *up, int p);
+void upd_block(struct upd *up, const int16_t *in, int16_t *out, size_t n);
+void upd_block_7(struct upd *up, const int16_t *in, int16_t *out, size_t n);
 void upd_fini(struct upd *up);
+
+/*
+ * Same as cur / len, rounding towards zero, for |cur| < 2^31.
+ */
+static inline int upd_div(const struct upd *up, int cur)
+{
+	if (cur >= 0)
+		return ((uint64_t) cur * up->mul) >> up->shift;
+	return -(int) (((uint64_t) -cur * up->mul) >> up->shift);
+}
+
+/*
+ * The block version of upd_ate(): out[i] is what upd_ate(up, in[i]) would
+ * return, and up is left as if upd_ate() was called n times. Instead of
+ * the ring, the sum subtracts the input from len samples back, so only
+ * the first len samples touch the ring.
+ *
+ * With a constant len this turns into a variant with the division by
+ * a constant, which the compiler does with a multiplication anyway.
+ * Keep in mind that in and out must not overlap.
+ */
+static inline __attribute__((always_inline))
+void upd_block_t(struct upd *up, const int16_t *in, int16_t *out, size_t n,
+    const int len, const int fixed)
+{
+	unsigned int x0, x;
+	size_t i, h;
+	int cur;
+
+	cur = up->cur;
+	x0 = up->x;
+
+	h = (n < len) ? n : len;
+	x = x0;
+	for (i = 0; i < h; i++) {
+		cur += in[i] - up->vec[x];
+		x = (x + 1 == len) ? 0 : x + 1;
+		out[i] = fixed ? cur / len : upd_div(up, cur);
+	}
+	for (; i < n; i++) {
+		cur += in[i] - in[i - len];
+		out[i] = fixed ? cur / len : upd_div(up, cur);
+	}
+
+	// Leave the last len samples in the ring, where upd_ate() wants them.
+	x = (x0 + n - h) % len;
+	for (i = n - h; i < n; i++) {
+		up->vec[x] = in[i];
+		x = (x + 1 == len) ? 0 : x + 1;
+	}
+	up->x = x;
+	up->cur = cur;
+}
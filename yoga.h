@@ -3,24 +3,72 @@
  * A dumping ground of global definitions
  */
 
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The structure that embeds the member at p, such as an rstate.
+#define container_of(p, type, member) \
+	((type *)((char *)(p) - offsetof(type, member)))
+
 // PM is the number of bits in preamble, 8.
 // XXX implement "-1st" or "9th" silent bit, check if more packets come in
 #define M     8
 
-// Samples per bit is 20 (for 20 Ms/s of real samples).
-#define SPB  20
-
-// Decimation factor is 5. It's explicit for a band correlator.
-#define DF    5
-
 // APP is the number of averaged samples in the preamble - 2 samples per 1 bit.
 #define APP  (M*2)
 
-// Number of tracks is only 2, basically one lucky and one unlucky.
-#define NT    2
+// The most tracks that any decoder variant uses.
+#define NTMAX 5
+
+// The front end converts this many samples at once.
+#define MAGLEN 16384
+
+// The smoothed magnitudes keep this much of the previous block in front,
+// enough for the window of the full-rate correlator, (APP-1)*spb/2, and
+// for a long frame that did not fit into the previous block, 112*spb.
+#define PVHIST 2432
+
+// The score of the full-rate correlator where nothing matched.
+#define PRE_NONE  (-32768)
+
+#define SOFT_BITS_MAX 3	// weak bits to try flipping against the parity
 
-// Yes, averaging length is larger than DF. Could be up to 10 (the half-bit).
-#define AVGLEN 7
+#define ICAO_TTL  60	// seconds to trust an address that went silent
+
+#define DUP_US    20	// an echo of a frame within this is dropped
+#define DUP_BITS  8	// log2 of the slots in the cache of recent frames
+
+// The longest frame with its preamble, in samples, and a bit more for the
+// lag of the smoother and for the look for a better phase.
+#define FRAME_MAX(var)  ((M + 112 + 1) * (var)->spb)
+
+// What a decoder that starts cold must see before the first frame it owns:
+// a whole frame, and 16 bits for the smoother and the correlator.
+#define FRAME_PRE(var)  (FRAME_MAX(var) + 2*M * (var)->spb)
+
+struct rstate;
+
+/*
+ * A decoder variant for one sample rate. The numbers are only here for
+ * the users. The decoder itself is built once per variant, with all of
+ * them as constants, see dec.c.
+ */
+struct dvar {
+	const char *name;
+	unsigned int srate;	// real samples per second
+	unsigned int spb;	// samples per bit, 20 at 20 Ms/s
+	unsigned int df;	// decimation factor for the preamble correlator
+	unsigned int nt;	// number of tracks, nt*df is a half-bit
+	unsigned int avglen;	// smoother length, up to a half-bit
+	void (*dec_mag)(struct rstate *rsp, const int16_t *mag, unsigned int n);
+	int (*pre_mask)(struct rstate *rsp, int p);	// the default
+	int (*pre_ring)(struct rstate *rsp, int p);	// the old one
+	void (*pre_scan)(const int16_t *pv, int16_t *score, unsigned int n);
+};
+
+// All variants, the default first, terminated by a NULL name.
+extern const struct dvar dvar_vec[];
 
 struct track {
 	int ap_u;
@@ -28,21 +76,112 @@ struct track {
 	int t_p[APP];
 };
 
+/*
+ * The decoder statistics. Only the decoding thread writes them, and only
+ * with plain stores. Everyone else looks at a copy published once per
+ * transfer under a sequence lock. The counts only go up.
+ */
+struct dstats {
+	unsigned long samples;
+	unsigned long errors;		// Manchester errors
+	unsigned long pre_hits;		// preamble matches
+	unsigned long frames_56, frames_112;
+	unsigned long drops;		// frames lost for the lack of room
+	unsigned long crc_bad;		// frames dropped for the parity
+	unsigned long crc_fixed;	// frames with bits fixed by the parity
+	unsigned long crc_soft;		// frames fixed by flipping weak bits
+	unsigned long ap_unknown;	// replies from unknown addresses
+	unsigned long dups;		// repeats of a recent frame
+
+	// The clock anchor: a sample index and the time when it arrived.
+	unsigned long anchor_n;
+	unsigned long anchor_rt;	// CLOCK_REALTIME, in ns
+	unsigned long anchor_mono;	// CLOCK_MONOTONIC, in ns
+};
+
+#define DSTATS_N  (sizeof(struct dstats) / sizeof(unsigned long))
+
+struct dstats_pub {
+	atomic_uint seq;
+	atomic_ulong v[DSTATS_N];
+};
+
+struct dup1 {
+	uint64_t t;		// the preamble of its last delivery
+	unsigned int len;	// in bytes, 0 if the slot is free
+	int src;		// where it came from, or -1
+	unsigned char packet[112/8];
+};
+
 /*
  * The receiver state: the bank of tracks, the smoother, etc.
  */
-enum R_state { HUNT, HALF, DATA };
+enum R_state { HUNT, DATA };
 struct rstate {
+	const struct dvar *var;
+	uint64_t clock;		// index of the next sample
+	uint64_t pre_n;		// where the preamble of the packet started
+	uint64_t frame_at;	// where its match was, for the DATA state
+	unsigned int dc_bias;
+	unsigned int bias_timer;
+	int16_t mag[MAGLEN];	// magnitudes from the front end
+	int16_t pv[PVHIST + MAGLEN];	// the same, smoothed, with history
+	int16_t score[MAGLEN];	// from the full-rate correlator
 	struct upd smoo;	// a smoother for half-bits
 	int dec;
 	enum R_state state;
-	unsigned int tx;	// running index 0..NT-1
-	struct track tvec[NT];
-	int p_half;
-	unsigned int data_len;	// expected length for HALF and DATA states
-	unsigned int bit_cnt;
+	unsigned int tx;	// running index 0..nt-1
+	struct track tvec[NTMAX];
+	int (*pre_match)(struct rstate *rsp, int p);	// NULL for the scan
+	int pre_best;		// the best score so far in a bunch of matches
+	unsigned int pre_age;	// samples since the best score
+	unsigned int pre_look;	// samples left to look for a better one
+	unsigned int hunt_skip;	// samples until the window is all fresh
+	unsigned int data_len;	// length of the packet being delivered
+	int clean;		// passed the parity as it came, see dec_addr()
+	unsigned int bit_cnt;	// bits sliced so far, for the DATA state
+	uint16_t conf[112];	// the confidence of every bit
+	int pre_level;		// the average pulse of the preamble
+	int erasures;		// bits without a level change
+	int fix_bits;		// how many bits to fix by the parity, 0 to 2
+	int soft_bits;		// how many weak bits to flip, 0 to 3
 	unsigned char packet[112/8];
+	struct icao *icao_p;	// the addresses we heard, or NULL for the merge
+	uint64_t own_lo, own_hi;	// only deliver the preambles in here
+	uint64_t dup_win;	// in samples, 0 to deliver the repeats
+	struct dup1 dupv[1 << DUP_BITS];
+	struct dstats st;
+	void (*deliver)(struct rstate *rsp);
 };
 
+const struct dvar *dvar_find(const char *name);
+int rstate_init(struct rstate *rsp, const struct dvar *var,
+    void (*deliver)(struct rstate *rsp));
+void rstate_hunt(struct rstate *rsp);
+void dec_bias(struct rstate *rsp, const unsigned char *sp, unsigned int n);
+void bias_update(unsigned int *biasp, unsigned int *timerp,
+    const unsigned char *sp, unsigned int n);
+void dec_block(struct rstate *rsp, const unsigned char *sp, unsigned int n);
+/*
+ * Convert a sample index into the 12 MHz clock used by MLAT feeds.
+ * The split keeps the multiplication from overflowing for ever.
+ */
+static inline uint64_t ts_mlat(uint64_t n, unsigned int srate)
+{
+	return (n / srate) * 12000000 + (n % srate) * 12000000 / srate;
+}
+
+int dec_addr(struct icao *ic, const unsigned char *pkt, unsigned int len,
+    int clean, uint64_t t);
+int dup_seen(struct dup1 *dupv, uint64_t win, const unsigned char *pkt,
+    unsigned int len, uint64_t t, int src);
+void stats_publish(struct dstats_pub *pub, const struct dstats *st);
+void stats_fetch(struct dstats_pub *pub, struct dstats *st);
 int preamble_match(struct rstate *rsp, int p);
-int bit_decode(struct rstate *rsp, int p);
+int preamble_match_2(struct rstate *rsp, int p);
+int preamble_match_5(struct rstate *rsp, int p);
+int preamble_mask_2(struct rstate *rsp, int p);
+int preamble_mask_5(struct rstate *rsp, int p);
+void pre_scan_10(const int16_t *pv, int16_t *score, unsigned int n);
+void pre_scan_6(const int16_t *pv, int16_t *score, unsigned int n);
+void pre_scan_5(const int16_t *pv, int16_t *score, unsigned int n);